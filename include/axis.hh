@@ -0,0 +1,66 @@
+#ifndef AXIS_HH
+#define AXIS_HH
+
+// bin lookup over sorted edges
+// find(x) returns the same index as std::upper_bound:
+// 0 for underflow, edges.size() for overflow and NaN
+//
+// Uniform edges, optionally with infinite outer edges, are found
+// arithmetically, corrected by at most one step against the actual edges,
+// so that rounding in (x-min)/width cannot move a value across an edge.
+// Other edges use a branchless binary search.
+
+#include <vector>
+#include <cmath>
+#include <cstddef>
+
+class axis {
+  std::vector<double> e;
+  size_t lo = 0, hi = 0; // uniform range of edges [lo,hi]
+  double min = 0, inv_width = 0, nuni = 0;
+  bool uniform = false;
+
+public:
+  axis() = default;
+  axis(const std::vector<double>& edges): e(edges) {
+    const size_t n = e.size();
+    if (n < 2) return;
+    lo = std::isinf(e.front());
+    hi = n - 1 - std::isinf(e.back());
+    if (hi <= lo) return;
+    const double width = (e[hi]-e[lo])/(hi-lo);
+    if (!(width > 0)) return;
+    for (size_t i=lo+1; i<=hi; ++i)
+      if (std::abs(e[i]-e[i-1]-width) > 1e-9*width) return;
+    min = e[lo];
+    inv_width = 1/width;
+    nuni = hi-lo;
+    uniform = true;
+  }
+
+  const std::vector<double>& edges() const noexcept { return e; }
+  bool is_uniform() const noexcept { return uniform; }
+
+  size_t find(double x) const noexcept {
+    const size_t n = e.size();
+    if (uniform) {
+      if (x!=x) return n;
+      const double t = (x-min)*inv_width;
+      size_t k = t < 0 ? lo : t >= nuni ? hi+1 : lo+1+size_t(t);
+      // number of edges <= x
+      if (k < n && e[k] <= x) ++k;
+      else if (k > 0 && e[k-1] > x) --k;
+      return k;
+    }
+    if (!n) return 0;
+    const double* base = e.data();
+    for (size_t len = n; len > 1; ) {
+      const size_t half = len/2;
+      base = !(x < base[half]) ? base+half : base;
+      len -= half;
+    }
+    return (base - e.data()) + !(x < *base);
+  }
+};
+
+#endif
@@ -0,0 +1,403 @@
+#ifndef BATCH_HH
+#define BATCH_HH
+
+// Events decoded in batches into SoA buffers,
+// so that variables are evaluated over a whole batch in tight loops
+// instead of one indirect call per event and variable.
+
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+constexpr unsigned batch_size = 1024;
+
+// one particle per event
+// missing jets are zero, so that sums need no branches
+struct batch_p4 {
+  double pt[batch_size], eta[batch_size], phi[batch_size], m[batch_size];
+  double px[batch_size], py[batch_size], pz[batch_size], e[batch_size];
+  double rap[batch_size];
+  bool cartesian = false; // px py pz e are filled
+  bool have_rap = false;
+
+  void to_cartesian(unsigned n) noexcept {
+    if (cartesian) return;
+    for (unsigned i=0; i<n; ++i) {
+      px[i] = pt[i]*std::cos(phi[i]);
+      py[i] = pt[i]*std::sin(phi[i]);
+      pz[i] = pt[i]*std::sinh(eta[i]);
+      e [i] = std::sqrt(px[i]*px[i] + py[i]*py[i] + pz[i]*pz[i] + m[i]*m[i]);
+    }
+    cartesian = true;
+  }
+  void add(const batch_p4& a, unsigned n) noexcept {
+    for (unsigned i=0; i<n; ++i) {
+      px[i] += a.px[i];
+      py[i] += a.py[i];
+      pz[i] += a.pz[i];
+      e [i] += a.e [i];
+    }
+  }
+
+  double cpt(unsigned i) const noexcept {
+    return std::sqrt(px[i]*px[i] + py[i]*py[i]);
+  }
+  double cm(unsigned i) const noexcept {
+    const double m2 = e[i]*e[i] - px[i]*px[i] - py[i]*py[i] - pz[i]*pz[i];
+    return m2 < 0 ? -std::sqrt(-m2) : std::sqrt(m2);
+  }
+  double crap(unsigned i) const noexcept {
+    return 0.5*std::log((e[i]+pz[i])/(e[i]-pz[i]));
+  }
+  // rapidities, computed once per batch for all variables that use them
+  const double* rapidity(unsigned n) noexcept {
+    if (!have_rap) {
+      to_cartesian(n);
+      for (unsigned i=0; i<n; ++i) rap[i] = crap(i);
+      have_rap = true;
+    }
+    return rap;
+  }
+};
+
+// events of a batch as added, before decode(),
+// to keep files in memory and reload them without decoding
+struct batch_events {
+  unsigned n = 0;
+  float raw[batch_size][6][4];
+  unsigned njets[batch_size];
+  double rest[5][batch_size]; // px py pz e ht of jets beyond the 4th
+};
+
+class event_batch {
+  bool have_yy = false, have_all = false, have_ht = false, have_ht_yy = false;
+  batch_p4 _yy, _all; // diphoton, diphoton + all jets
+  double _ht[batch_size], _ht_yy[batch_size];
+  float raw[batch_size][6][4]; // photons and jets as added
+  unsigned nraw = 0; // events added as rows, to be decoded
+
+public:
+  unsigned n = 0;
+  batch_p4 y[2], j[4]; // stored jets, at most 4
+  unsigned njets[batch_size]; // all jets
+  // jets beyond the stored ones, only in files that keep all jets
+  double rest_px[batch_size], rest_py[batch_size], rest_pz[batch_size],
+         rest_e[batch_size], rest_ht[batch_size];
+  std::vector<float> weights; // [nweights][batch_size]
+  unsigned nweights = 0;
+
+  void set_nweights(unsigned nw) {
+    nweights = nw;
+    weights.resize(size_t(nw)*batch_size);
+  }
+  bool full() const noexcept { return n==batch_size; }
+  void clear() noexcept {
+    n = nraw = 0;
+    have_yy = have_all = have_ht = have_ht_yy = false;
+    for (auto& p : y) p.cartesian = p.have_rap = false;
+    for (auto& p : j) p.cartesian = p.have_rap = false;
+  }
+
+  // momenta are unaligned pt eta phi m floats
+  // they are copied as they are and transposed by decode()
+  void add(const char* y1, const char* y2, unsigned nj,
+           unsigned nj_stored, const char* jets,
+           const char* w = nullptr) noexcept {
+    float* r = raw[n][0];
+    memcpy(r,y1,sizeof(float[4]));
+    memcpy(r+4,y2,sizeof(float[4]));
+    const unsigned k = nj_stored < 4 ? nj_stored : 4;
+    memcpy(r+8,jets,sizeof(float[4])*k);
+    memset(r+8+4*k,0,sizeof(float[4])*(4-k));
+    njets[n] = nj;
+    rest_px[n] = rest_py[n] = rest_pz[n] = rest_e[n] = rest_ht[n] = 0;
+    for (unsigned k=4; k<nj_stored; ++k) {
+      float mom[4];
+      memcpy(mom,jets+sizeof(mom)*k,sizeof(mom));
+      const double px = mom[0]*std::cos(mom[2]), py = mom[0]*std::sin(mom[2]),
+                   pz = mom[0]*std::sinh(mom[1]);
+      rest_px[n] += px;
+      rest_py[n] += py;
+      rest_pz[n] += pz;
+      rest_e [n] += std::sqrt(px*px + py*py + pz*pz + double(mom[3])*mom[3]);
+      rest_ht[n] += mom[0];
+    }
+    for (unsigned k=0; k<nweights; ++k)
+      memcpy(&weights[size_t(k)*batch_size+n],w+sizeof(float)*k,
+             sizeof(float));
+    nraw = ++n;
+  }
+
+  // events [i,i+m) of a block of columns, hgam_columns in reader2.hh,
+  // copied directly into the SoA arrays, without decode()
+  // jet is the first stored jet of event i, advanced past the events
+  // a batch is filled either with add() or with add_columns()
+  template <typename Columns>
+  void add_columns(
+    const Columns& c, uint32_t i, unsigned m, uint32_t& jet
+  ) noexcept {
+    for (unsigned k=0; k<2; ++k) {
+      batch_p4& p = y[k];
+      double* x[] { p.pt+n, p.eta+n, p.phi+n, p.m+n };
+      for (unsigned a=0; a<4; ++a)
+        std::copy(c.y[k][a]+i,c.y[k][a]+i+m,x[a]);
+    }
+    for (unsigned l=0; l<m; ++l) {
+      const unsigned nj = c.njets[i+l], ns = nj < 4 ? nj : 4;
+      njets[n+l] = nj;
+      for (unsigned k=0; k<4; ++k) {
+        batch_p4& p = j[k];
+        const bool has = k < ns;
+        p.pt [n+l] = has ? c.jets[0][jet+k] : 0;
+        p.eta[n+l] = has ? c.jets[1][jet+k] : 0;
+        p.phi[n+l] = has ? c.jets[2][jet+k] : 0;
+        p.m  [n+l] = has ? c.jets[3][jet+k] : 0;
+      }
+      jet += ns;
+    }
+    for (double* r : { rest_px, rest_py, rest_pz, rest_e, rest_ht })
+      std::fill(r+n,r+n+m,0.);
+    for (unsigned k=0; k<nweights; ++k)
+      std::copy(c.weight[k]+i,c.weight[k]+i+m,
+                &weights[size_t(k)*batch_size+n]);
+    n += m;
+  }
+
+  void save(batch_events& e) const noexcept {
+    e.n = n;
+    memcpy(e.raw,raw,sizeof(float[6][4])*n);
+    memcpy(e.njets,njets,sizeof(unsigned)*n);
+    const double* rest[] { rest_px, rest_py, rest_pz, rest_e, rest_ht };
+    for (unsigned k=0; k<5; ++k) memcpy(e.rest[k],rest[k],sizeof(double)*n);
+  }
+  // replaces the events, without weights
+  void load(const batch_events& e) noexcept {
+    clear();
+    n = nraw = e.n;
+    memcpy(raw,e.raw,sizeof(float[6][4])*n);
+    memcpy(njets,e.njets,sizeof(unsigned)*n);
+    double* rest[] { rest_px, rest_py, rest_pz, rest_e, rest_ht };
+    for (unsigned k=0; k<5; ++k) memcpy(rest[k],e.rest[k],sizeof(double)*n);
+  }
+
+  // fill the SoA arrays, called once the batch is complete
+  void decode() noexcept {
+    for (unsigned k=0; k<6; ++k) {
+      batch_p4& p = k<2 ? y[k] : j[k-2];
+      for (unsigned i=0; i<nraw; ++i) p.pt [i] = raw[i][k][0];
+      for (unsigned i=0; i<nraw; ++i) p.eta[i] = raw[i][k][1];
+      for (unsigned i=0; i<nraw; ++i) p.phi[i] = raw[i][k][2];
+      for (unsigned i=0; i<nraw; ++i) p.m  [i] = raw[i][k][3];
+    }
+  }
+
+  float weight(unsigned k, unsigned i) const noexcept {
+    return weights[size_t(k)*batch_size+i];
+  }
+
+  const batch_p4& photon(unsigned k) noexcept {
+    y[k].to_cartesian(n);
+    return y[k];
+  }
+  const batch_p4& jet(unsigned k) noexcept {
+    j[k].to_cartesian(n);
+    return j[k];
+  }
+  const double* rap_photon(unsigned k) noexcept { return y[k].rapidity(n); }
+  const double* rap_jet(unsigned k) noexcept { return j[k].rapidity(n); }
+  const batch_p4& yy() noexcept {
+    if (!have_yy) {
+      memcpy(_yy.px,photon(0).px,sizeof(double)*n);
+      memcpy(_yy.py,y[0].py,sizeof(double)*n);
+      memcpy(_yy.pz,y[0].pz,sizeof(double)*n);
+      memcpy(_yy.e ,y[0].e ,sizeof(double)*n);
+      _yy.add(photon(1),n);
+      have_yy = true;
+    }
+    return _yy;
+  }
+  const batch_p4& all() noexcept { // diphoton + all jets
+    if (!have_all) {
+      const auto& a = yy();
+      for (unsigned i=0; i<n; ++i) {
+        _all.px[i] = a.px[i] + rest_px[i];
+        _all.py[i] = a.py[i] + rest_py[i];
+        _all.pz[i] = a.pz[i] + rest_pz[i];
+        _all.e [i] = a.e [i] + rest_e [i];
+      }
+      for (unsigned k=0; k<4; ++k) _all.add(jet(k),n);
+      have_all = true;
+    }
+    return _all;
+  }
+  const double* ht() noexcept { // scalar sum of jets pt
+    if (!have_ht) {
+      for (unsigned i=0; i<n; ++i)
+        _ht[i] = j[0].pt[i] + j[1].pt[i] + j[2].pt[i] + j[3].pt[i]
+               + rest_ht[i];
+      have_ht = true;
+    }
+    return _ht;
+  }
+  const double* ht_yy() noexcept {
+    if (!have_ht_yy) {
+      const double* h = ht();
+      const auto& a = yy();
+      for (unsigned i=0; i<n; ++i) _ht_yy[i] = h[i] + a.cpt(i);
+      have_ht_yy = true;
+    }
+    return _ht_yy;
+  }
+};
+
+// evaluates a variable for all events in the batch
+using batch_fcn = void(*)(event_batch&, double*);
+
+namespace batch_fcns_impl {
+
+template <unsigned k>
+void pt_j(event_batch& b, double* x) {
+  for (unsigned i=0; i<b.n; ++i) x[i] = b.njets[i] > k ? b.j[k].pt[i] : 0;
+}
+template <unsigned k>
+void eta_j(event_batch& b, double* x) {
+  for (unsigned i=0; i<b.n; ++i)
+    x[i] = b.njets[i] > k ? b.j[k].eta[i] : NAN;
+}
+template <unsigned k>
+void y_j(event_batch& b, double* x) {
+  const double* r = b.rap_jet(k);
+  for (unsigned i=0; i<b.n; ++i) x[i] = b.njets[i] > k ? r[i] : NAN;
+}
+template <unsigned k>
+void x_j(event_batch& b, double* x) {
+  const double* h = b.ht_yy();
+  for (unsigned i=0; i<b.n; ++i)
+    x[i] = b.njets[i] > k ? b.j[k].pt[i]/h[i] : 0;
+}
+
+}
+
+const std::map<std::string,batch_fcn> batch_fcns {
+  { "pT_yy", [](event_batch& b, double* x){
+      const auto& p = b.yy();
+      for (unsigned i=0; i<b.n; ++i) x[i] = p.cpt(i);
+    } },
+  { "m_yy", [](event_batch& b, double* x){
+      const auto& p = b.yy();
+      for (unsigned i=0; i<b.n; ++i) x[i] = p.cm(i);
+    } },
+  { "pT_y1", [](event_batch& b, double* x){
+      std::copy(b.y[0].pt,b.y[0].pt+b.n,x);
+    } },
+  { "pT_y2", [](event_batch& b, double* x){
+      std::copy(b.y[1].pt,b.y[1].pt+b.n,x);
+    } },
+  { "rat_pT_y1_y2", [](event_batch& b, double* x){
+      for (unsigned i=0; i<b.n; ++i) x[i] = b.y[0].pt[i]/b.y[1].pt[i];
+    } },
+  { "eta_y1", [](event_batch& b, double* x){
+      std::copy(b.y[0].eta,b.y[0].eta+b.n,x);
+    } },
+  { "eta_y2", [](event_batch& b, double* x){
+      std::copy(b.y[1].eta,b.y[1].eta+b.n,x);
+    } },
+  { "y_y1", [](event_batch& b, double* x){
+      std::copy(b.rap_photon(0),b.rap_photon(0)+b.n,x);
+    } },
+  { "y_y2", [](event_batch& b, double* x){
+      std::copy(b.rap_photon(1),b.rap_photon(1)+b.n,x);
+    } },
+  { "dy_y1_y2", [](event_batch& b, double* x){
+      const double *r1 = b.rap_photon(0), *r2 = b.rap_photon(1);
+      for (unsigned i=0; i<b.n; ++i) x[i] = std::abs(r1[i]-r2[i]);
+    } },
+
+  { "Njets", [](event_batch& b, double* x){
+      for (unsigned i=0; i<b.n; ++i) x[i] = b.njets[i];
+    } },
+  { "pT_j1", batch_fcns_impl::pt_j<0> },
+  { "pT_j2", batch_fcns_impl::pt_j<1> },
+  { "pT_j3", batch_fcns_impl::pt_j<2> },
+  { "eta_j1", batch_fcns_impl::eta_j<0> },
+  { "eta_j2", batch_fcns_impl::eta_j<1> },
+  { "eta_j3", batch_fcns_impl::eta_j<2> },
+  { "y_j1", batch_fcns_impl::y_j<0> },
+  { "y_j2", batch_fcns_impl::y_j<1> },
+  { "y_j3", batch_fcns_impl::y_j<2> },
+  { "dy_j1_j2", [](event_batch& b, double* x){
+      const double *r1 = b.rap_jet(0), *r2 = b.rap_jet(1);
+      for (unsigned i=0; i<b.n; ++i)
+        x[i] = b.njets[i] > 1 ? std::abs(r1[i]-r2[i]) : NAN;
+    } },
+  { "m_jj", [](event_batch& b, double* x){
+      const auto &p1 = b.jet(0), &p2 = b.jet(1);
+      for (unsigned i=0; i<b.n; ++i) {
+        const double e  = p1.e [i] + p2.e [i], px = p1.px[i] + p2.px[i],
+                     py = p1.py[i] + p2.py[i], pz = p1.pz[i] + p2.pz[i];
+        const double m2 = e*e - px*px - py*py - pz*pz;
+        x[i] = b.njets[i] > 1 ? (m2 < 0 ? -std::sqrt(-m2) : std::sqrt(m2))
+                              : NAN;
+      }
+    } },
+
+  { "Hj_mass", [](event_batch& b, double* x){
+      const auto &p1 = b.yy(), &p2 = b.jet(0);
+      for (unsigned i=0; i<b.n; ++i) {
+        const double e  = p1.e [i] + p2.e [i], px = p1.px[i] + p2.px[i],
+                     py = p1.py[i] + p2.py[i], pz = p1.pz[i] + p2.pz[i];
+        const double m2 = e*e - px*px - py*py - pz*pz;
+        x[i] = b.njets[i] > 0 ? (m2 < 0 ? -std::sqrt(-m2) : std::sqrt(m2))
+                              : NAN;
+      }
+    } },
+
+  { "HT_jets", [](event_batch& b, double* x){
+      std::copy(b.ht(),b.ht()+b.n,x);
+    } },
+  { "HT_jets_yy", [](event_batch& b, double* x){
+      std::copy(b.ht_yy(),b.ht_yy()+b.n,x);
+    } },
+
+  { "x_yy", [](event_batch& b, double* x){
+      const double* h = b.ht_yy();
+      const auto& p = b.yy();
+      for (unsigned i=0; i<b.n; ++i) x[i] = p.cpt(i)/h[i];
+    } },
+  { "x_j1", batch_fcns_impl::x_j<0> },
+  { "x_j2", batch_fcns_impl::x_j<1> },
+  { "x_j3", batch_fcns_impl::x_j<2> },
+
+  { "pT_miss", [](event_batch& b, double* x){
+      const auto& p = b.all();
+      for (unsigned i=0; i<b.n; ++i) x[i] = p.cpt(i);
+    } },
+  { "s2", [](event_batch& b, double* x){
+      const auto& p = b.all();
+      for (unsigned i=0; i<b.n; ++i) x[i] = p.cm(i);
+    } },
+};
+
+// bin indices of a batch of n events for a multidimensional binning
+// vars have ax, the axis (axis.hh), values(var) are the variable's values
+// bin[i] is set to -1 for events outside the binning
+template <typename Vars, typename Values>
+void find_bins(unsigned n, const Vars& vars, Values&& values, long* bin) {
+  std::fill(bin,bin+n,0);
+  long stride = 1;
+  for (const auto& var : vars) {
+    const double* x = values(var);
+    const auto& ax = var.ax;
+    const long nb = ax.edges().size();
+    for (unsigned i=0; i<n; ++i) {
+      const long k = ax.find(x[i]);
+      bin[i] = (bin[i] < 0 || k==0 || k==nb) ? -1 : bin[i] + (k-1)*stride;
+    }
+    stride *= nb-1;
+  }
+}
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef BOOTSTRAP_HH
+#define BOOTSTRAP_HH
+
+// Poisson(1) weights for bootstrap replicas
+// Each weight is a hash of (event seed, replica), so replicas do not depend
+// on the number of threads or the order in which events are read.
+// The event seed combines the shard, the event's position in it, and the
+// event's content, so that shards with the same name, or streams,
+// do not get the same weights.
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+inline uint64_t splitmix64(uint64_t x) noexcept {
+  x += 0x9E3779B97F4A7C15ull;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+  return x ^ (x >> 31);
+}
+
+// stable across platforms, unlike std::hash
+inline uint64_t fnv1a(std::string_view s) noexcept {
+  uint64_t h = 0xCBF29CE484222325ull;
+  for (char c : s) {
+    h ^= uint8_t(c);
+    h *= 0x100000001B3ull;
+  }
+  return h;
+}
+
+// content: a hash of the event's values, see mix()
+inline uint64_t event_seed(
+  uint64_t shard_seed, uint64_t event, uint64_t content
+) noexcept {
+  return splitmix64(shard_seed ^ splitmix64(event ^ splitmix64(content)));
+}
+
+// adds a value to a hash
+inline uint64_t mix(uint64_t h, double x) noexcept {
+  uint64_t bits;
+  memcpy(&bits,&x,sizeof(bits));
+  return splitmix64(h ^ bits);
+}
+
+// k[r] ~ Poisson(1) for r < n, by inverting the CDF without branches
+// truncated at 12, which has probability 1e-9
+inline void poisson1(uint64_t seed, unsigned n, float* k) noexcept {
+  static constexpr double cdf[] {
+    0.36787944117144233, 0.7357588823428847, 0.9196986029286058,
+    0.9810118431238463, 0.9963401531726563, 0.9994058151824183,
+    0.999916758850712, 0.9999897508033253, 0.999998874797402,
+    0.9999998885745216, 0.9999999899522336, 0.9999999991683892
+  };
+  for (unsigned r=0; r<n; ++r) {
+    const double u = (splitmix64(seed + r) >> 11) * 0x1p-53;
+    unsigned x = 0;
+    for (double c : cdf) x += (u >= c);
+    k[r] = x;
+  }
+}
+
+#endif
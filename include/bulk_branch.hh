@@ -0,0 +1,104 @@
+#ifndef BULK_BRANCH_HH
+#define BULK_BRANCH_HH
+
+// Direct TBranch access, bypassing TTreeReader.
+// Entries are read one branch at a time into flat buffers,
+// so cuts can be applied to a whole cluster before the rest is read.
+// Ranges of scalar entries are read a basket at a time with the bulk API,
+// which deserializes the basket straight into a buffer.
+// Selected entries and vectors are read with GetEntry.
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <TTree.h>
+#include <TBufferFile.h>
+#include "ivanp/error.hh"
+
+inline TBranch* get_branch(TTree* tree, const char* name) {
+  TBranch* b = tree->GetBranch(name);
+  if (!b) throw ivanp::error("no branch \"",name,'\"');
+  return b;
+}
+
+template <typename T>
+class scalar_branch {
+  TBranch* b;
+  T x;
+  TBufferFile bulk { TBuffer::kWrite, 1 << 16 };
+  bool bulk_ok;
+
+public:
+  scalar_branch(TTree* tree, const char* name)
+  : b(get_branch(tree,name)), bulk_ok(b->GetBulkRead().SupportsBulkRead()) {
+    b->SetAddress(&x);
+  }
+  scalar_branch(const scalar_branch&) = delete; // b points to x
+  scalar_branch(scalar_branch&&) = delete;
+
+  // entries [first,last)
+  void read(Long64_t first, Long64_t last, std::vector<T>& buf) {
+    buf.resize(last-first);
+    Long64_t i = first;
+    if (bulk_ok) {
+      // GetBulkEntries reads the whole basket containing an entry
+      const Long64_t* be = b->GetBasketEntry();
+      const Long64_t* k = std::upper_bound(be,be+b->GetWriteBasket(),i);
+      Long64_t basket = k==be ? 0 : k[-1];
+      while (i < last) {
+        const Int_t n = b->GetBulkRead().GetBulkEntries(basket,bulk);
+        if (n <= 0 || basket+n <= i) { bulk_ok = false; break; }
+        const Long64_t end = std::min(basket+n,last);
+        memcpy(buf.data()+(i-first), bulk.GetCurrent()+sizeof(T)*(i-basket),
+               sizeof(T)*(end-i));
+        i = end;
+        basket += n;
+      }
+    }
+    for (; i<last; ++i) { b->GetEntry(i); buf[i-first] = x; }
+  }
+  // selected entries
+  void read(const std::vector<Long64_t>& entries, std::vector<T>& buf) {
+    buf.resize(entries.size());
+    for (size_t i=0; i<entries.size(); ++i) {
+      b->GetEntry(entries[i]);
+      buf[i] = x;
+    }
+  }
+};
+
+// std::vector<T> per entry, flattened
+template <typename T>
+struct jagged {
+  std::vector<T> v;
+  std::vector<uint32_t> off { 0 };
+
+  void clear() { v.clear(); off.resize(1); }
+  const T* operator[](size_t i) const { return v.data() + off[i]; }
+  uint32_t size(size_t i) const { return off[i+1] - off[i]; }
+};
+
+template <typename T>
+class vector_branch {
+  TBranch* b;
+  std::vector<T> x, *p = &x;
+
+public:
+  vector_branch(TTree* tree, const char* name): b(get_branch(tree,name)) {
+    b->SetAddress(&p);
+  }
+  vector_branch(const vector_branch&) = delete; // b points to p
+  vector_branch(vector_branch&&) = delete;
+
+  void read(const std::vector<Long64_t>& entries, jagged<T>& buf) {
+    buf.clear();
+    buf.off.reserve(entries.size()+1);
+    for (auto i : entries) {
+      b->GetEntry(i);
+      buf.v.insert(buf.v.end(),x.begin(),x.end());
+      buf.off.push_back(buf.v.size());
+    }
+  }
+};
+
+#endif
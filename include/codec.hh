@@ -0,0 +1,135 @@
+#ifndef CODEC_HH
+#define CODEC_HH
+
+// Dependency-free block codec for hgam .dat files.
+// Bytes of 4-byte words are shuffled into planes, so that
+// exponents and high mantissa bytes of floats end up next to each other,
+// then compressed with a byte oriented LZ77 in the spirit of LZ4.
+// The words must be aligned floats, as in columnar blocks.
+//
+// LZ sequence: token [literal length+] literals [offset match length+]
+//   token: high nibble literal length, low nibble match length - 4,
+//          15 means more length bytes follow, until one is not 255
+//   offset: uint16_t, little endian
+//   the last sequence has only literals
+
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "ivanp/error.hh"
+
+inline void shuffle4(const char* in, size_t n, char* out) noexcept {
+  const size_t nw = n/4;
+  for (size_t i=0; i<nw; ++i)
+    for (size_t k=0; k<4; ++k)
+      out[k*nw+i] = in[i*4+k];
+  memcpy(out+nw*4, in+nw*4, n-nw*4);
+}
+
+inline void unshuffle4(const char* in, size_t n, char* out) noexcept {
+  const size_t nw = n/4;
+  for (size_t k=0; k<4; ++k)
+    for (size_t i=0; i<nw; ++i)
+      out[i*4+k] = in[k*nw+i];
+  memcpy(out+nw*4, in+nw*4, n-nw*4);
+}
+
+inline void lz_compress(const char* _in, size_t n, std::string& out) {
+  const auto* in = reinterpret_cast<const uint8_t*>(_in);
+  constexpr unsigned hash_bits = 14;
+  std::vector<uint32_t> table(1u << hash_bits); // position + 1
+
+  auto put_len = [&](size_t len){
+    for (; len >= 255; len -= 255) out += char(255);
+    out += char(len);
+  };
+  size_t lit = 0; // first pending literal
+  auto emit = [&](size_t lit_end, size_t mlen, size_t off){
+    const size_t ll = lit_end - lit, ml = mlen ? mlen-4 : 0;
+    out += char((ll < 15 ? ll : 15) << 4 | (ml < 15 ? ml : 15));
+    if (ll >= 15) put_len(ll-15);
+    out.append(_in+lit, ll);
+    if (mlen) {
+      out += char(off);
+      out += char(off >> 8);
+      if (ml >= 15) put_len(ml-15);
+    }
+  };
+
+  for (size_t i=0; i+4 <= n; ) {
+    uint32_t x;
+    memcpy(&x,in+i,4);
+    auto& h = table[(x*2654435761u) >> (32-hash_bits)];
+    const size_t m = size_t(h) - 1;
+    h = i + 1;
+    if (m < i && i-m <= 0xFFFF && !memcmp(in+m,in+i,4)) {
+      size_t len = 4;
+      while (i+len < n && in[m+len]==in[i+len]) ++len;
+      emit(i,len,i-m);
+      i += len;
+      lit = i;
+    } else ++i;
+  }
+  emit(n,0,0);
+}
+
+inline void lz_decompress(const char* _in, size_t n, char* _out, size_t nout) {
+  const auto *ip = reinterpret_cast<const uint8_t*>(_in), *iend = ip + n;
+  auto *op = reinterpret_cast<uint8_t*>(_out), *o = op, *oend = op + nout;
+  auto corrupt = []{ return ivanp::error("corrupt compressed block"); };
+
+  auto get_len = [&](size_t len){
+    if (len==15) for (uint8_t b=255; b==255; len += b) {
+      if (ip==iend) throw corrupt();
+      b = *ip++;
+    }
+    return len;
+  };
+
+  for (;;) {
+    if (ip==iend) throw corrupt();
+    const uint8_t token = *ip++;
+    const size_t ll = get_len(token >> 4);
+    if (ll > size_t(iend-ip) || ll > size_t(oend-o)) throw corrupt();
+    memcpy(o,ip,ll);
+    o += ll;
+    ip += ll;
+    if (ip==iend) break;
+
+    if (iend-ip < 2) throw corrupt();
+    const size_t off = ip[0] | size_t(ip[1]) << 8;
+    ip += 2;
+    const size_t ml = get_len(token & 15) + 4;
+    if (!off || off > size_t(o-op) || ml > size_t(oend-o)) throw corrupt();
+    const uint8_t* m = o - off;
+    if (off >= ml) {
+      memcpy(o,m,ml);
+      o += ml;
+    } else for (size_t i=0; i<ml; ++i) *o++ = *m++;
+  }
+  if (o != oend) throw corrupt();
+}
+
+// returns false if the block does not compress
+inline bool block_compress(
+  const std::string& in, std::string& out, std::string& shuffled
+) {
+  shuffled.resize(in.size());
+  shuffle4(in.data(),in.size(),shuffled.data());
+  out.clear();
+  lz_compress(shuffled.data(),shuffled.size(),out);
+  return out.size() < in.size();
+}
+
+inline void block_decompress(
+  const char* in, size_t n, std::vector<char>& out, size_t nout,
+  std::vector<char>& shuffled
+) {
+  shuffled.resize(nout);
+  lz_decompress(in,n,shuffled.data(),nout);
+  out.resize(nout);
+  unshuffle4(shuffled.data(),nout,out.data());
+}
+
+#endif
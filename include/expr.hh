@@ -0,0 +1,234 @@
+#ifndef EXPR_HH
+#define EXPR_HH
+
+// expressions of batch variables (batch.hh), e.g.
+//   pT_yy/m_yy
+//   abs(eta_j1-eta_j2)>3 && m_jj>400
+//
+// Expressions are parsed once into a list of operations on columns of
+// batch_size values, evaluated for a whole batch at a time.
+// Identical subexpressions, also across expressions added to the same
+// program, are computed once.
+// Comparisons and logical operators give 1 or 0.
+// Comparisons with NaN give 0, except != which gives 1,
+// and logical operators take NaN as true, so !NaN is 0.
+// min and max ignore a NaN argument, so they are symmetric.
+//
+// operators, lowest precedence first:
+//   ||   &&   == !=   < <= > >=   + -   * /   unary - !
+// functions: abs sqrt exp log pow min max
+
+#include <string>
+#include <vector>
+#include <map>
+#include <tuple>
+#include <cmath>
+#include <cstdlib>
+#include <cctype>
+#include <cstring>
+
+#include "ivanp/error.hh"
+#include "batch.hh"
+
+class expr_program {
+  enum op_t {
+    op_var, op_cnst, op_neg, op_not, op_add, op_sub, op_mul, op_div,
+    op_lt, op_le, op_gt, op_ge, op_eq, op_ne, op_and, op_or,
+    op_abs, op_sqrt, op_exp, op_log, op_pow, op_min, op_max
+  };
+  struct instr { op_t op; unsigned a, b; batch_fcn f; };
+
+  std::vector<instr> code; // one per column, operands come first
+  std::vector<std::vector<double>> cols;
+  std::map<std::tuple<op_t,unsigned,unsigned,double,std::string>,unsigned>
+    cse;
+
+  unsigned node(op_t op, unsigned a=0, unsigned b=0,
+                double c=0, const std::string& name={}) {
+    if (b < a && (op==op_add || op==op_mul || op==op_eq || op==op_ne ||
+                  op==op_and || op==op_or || op==op_min || op==op_max))
+      std::swap(a,b);
+    batch_fcn f = nullptr;
+    if (op==op_var) {
+      const auto it = batch_fcns.find(name);
+      if (it==batch_fcns.end())
+        throw ivanp::error("unknown variable \"",name,'\"');
+      f = it->second;
+    }
+    const auto [it,added] = cse.try_emplace({op,a,b,c,name},cols.size());
+    if (added) {
+      cols.emplace_back(batch_size,c);
+      code.push_back({op,a,b,f});
+    }
+    return it->second;
+  }
+
+  // recursive descent parser
+  struct parser {
+    expr_program& prog;
+    const char* p;
+
+    bool next(const char* tok) {
+      while (std::isspace(*p)) ++p;
+      const size_t n = strlen(tok);
+      if (strncmp(p,tok,n)) return false;
+      // don't take < for <=, ! for !=
+      if (n==1 && (*tok=='<' || *tok=='>' || *tok=='!' || *tok=='=')
+          && p[1]=='=') return false;
+      p += n;
+      return true;
+    }
+    void expect(const char* tok) {
+      if (!next(tok)) throw ivanp::error("expected \'",tok,"\' at \"",p,'\"');
+    }
+
+    unsigned lor_() {
+      unsigned a = land_();
+      while (next("||")) a = prog.node(op_or,a,land_());
+      return a;
+    }
+    unsigned land_() {
+      unsigned a = eq_();
+      while (next("&&")) a = prog.node(op_and,a,eq_());
+      return a;
+    }
+    unsigned eq_() {
+      unsigned a = cmp_();
+      for (;;) {
+        if (next("==")) a = prog.node(op_eq,a,cmp_()); else
+        if (next("!=")) a = prog.node(op_ne,a,cmp_()); else
+        return a;
+      }
+    }
+    unsigned cmp_() {
+      unsigned a = sum_();
+      for (;;) {
+        if (next("<=")) a = prog.node(op_le,a,sum_()); else
+        if (next(">=")) a = prog.node(op_ge,a,sum_()); else
+        if (next("<" )) a = prog.node(op_lt,a,sum_()); else
+        if (next(">" )) a = prog.node(op_gt,a,sum_()); else
+        return a;
+      }
+    }
+    unsigned sum_() {
+      unsigned a = prod_();
+      for (;;) {
+        if (next("+")) a = prog.node(op_add,a,prod_()); else
+        if (next("-")) a = prog.node(op_sub,a,prod_()); else
+        return a;
+      }
+    }
+    unsigned prod_() {
+      unsigned a = unary_();
+      for (;;) {
+        if (next("*")) a = prog.node(op_mul,a,unary_()); else
+        if (next("/")) a = prog.node(op_div,a,unary_()); else
+        return a;
+      }
+    }
+    unsigned unary_() {
+      if (next("-")) return prog.node(op_neg,unary_());
+      if (next("!")) return prog.node(op_not,unary_());
+      if (next("+")) return unary_();
+      return primary_();
+    }
+    unsigned primary_() {
+      while (std::isspace(*p)) ++p;
+      if (next("(")) {
+        const unsigned a = lor_();
+        expect(")");
+        return a;
+      }
+      if (std::isdigit(*p) || *p=='.') {
+        char* end;
+        const double x = std::strtod(p,&end);
+        p = end;
+        return prog.node(op_cnst,0,0,x);
+      }
+      if (!(std::isalpha(*p) || *p=='_'))
+        throw ivanp::error("unexpected \"",p,'\"');
+      const char* a = p;
+      while (std::isalnum(*p) || *p=='_') ++p;
+      const std::string name(a,p);
+      if (!next("(")) {
+        if (name=="inf") return prog.node(op_cnst,0,0,INFINITY);
+        return prog.node(op_var,0,0,0,name);
+      }
+      static const std::map<std::string,std::pair<op_t,unsigned>> fcns {
+        {"abs",{op_abs,1}}, {"sqrt",{op_sqrt,1}}, {"exp",{op_exp,1}},
+        {"log",{op_log,1}}, {"pow",{op_pow,2}}, {"min",{op_min,2}},
+        {"max",{op_max,2}}
+      };
+      const auto f = fcns.find(name);
+      if (f==fcns.end())
+        throw ivanp::error("unknown function \"",name,'\"');
+      const unsigned x = lor_();
+      unsigned y = 0;
+      if (f->second.second==2) {
+        expect(",");
+        y = lor_();
+      }
+      expect(")");
+      return prog.node(f->second.first,x,y);
+    }
+  };
+
+public:
+  // returns the column of the expression's values
+  unsigned add(const std::string& expr) {
+    try {
+      parser parse { *this, expr.c_str() };
+      const unsigned a = parse.lor_();
+      while (std::isspace(*parse.p)) ++parse.p;
+      if (*parse.p) throw ivanp::error("unexpected \"",parse.p,'\"');
+      return a;
+    } catch (const std::exception& e) {
+      throw ivanp::error("in expression \"",expr,"\": ",e.what());
+    }
+  }
+
+  // evaluate all expressions for the batch
+  void operator()(event_batch& b) {
+    const unsigned n = b.n;
+    for (size_t k=0; k<code.size(); ++k) {
+      const instr& c = code[k];
+      double* const x = cols[k].data();
+      const double *const u = cols[c.a].data(), *const v = cols[c.b].data();
+#define EXPR_LOOP(...) \
+      { for (unsigned i=0; i<n; ++i) x[i] = (__VA_ARGS__); } break;
+      switch (c.op) {
+        case op_var: c.f(b,x); break;
+        case op_cnst: break;
+        case op_neg:  EXPR_LOOP( -u[i] )
+        case op_not:  EXPR_LOOP( !u[i] )
+        case op_add:  EXPR_LOOP( u[i] + v[i] )
+        case op_sub:  EXPR_LOOP( u[i] - v[i] )
+        case op_mul:  EXPR_LOOP( u[i] * v[i] )
+        case op_div:  EXPR_LOOP( u[i] / v[i] )
+        case op_lt:   EXPR_LOOP( u[i] <  v[i] )
+        case op_le:   EXPR_LOOP( u[i] <= v[i] )
+        case op_gt:   EXPR_LOOP( u[i] >  v[i] )
+        case op_ge:   EXPR_LOOP( u[i] >= v[i] )
+        case op_eq:   EXPR_LOOP( u[i] == v[i] )
+        case op_ne:   EXPR_LOOP( u[i] != v[i] )
+        case op_and:  EXPR_LOOP( u[i] && v[i] )
+        case op_or:   EXPR_LOOP( u[i] || v[i] )
+        case op_abs:  EXPR_LOOP( std::abs(u[i]) )
+        case op_sqrt: EXPR_LOOP( std::sqrt(u[i]) )
+        case op_exp:  EXPR_LOOP( std::exp(u[i]) )
+        case op_log:  EXPR_LOOP( std::log(u[i]) )
+        case op_pow:  EXPR_LOOP( std::pow(u[i],v[i]) )
+        case op_min:  EXPR_LOOP( std::fmin(u[i],v[i]) )
+        case op_max:  EXPR_LOOP( std::fmax(u[i],v[i]) )
+      }
+#undef EXPR_LOOP
+    }
+  }
+
+  const double* operator[](unsigned col) const noexcept {
+    return cols[col].data();
+  }
+  size_t size() const noexcept { return cols.size(); }
+};
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef HIST_HH
+#define HIST_HH
+
+// bins of one binning, for each weight
+// Dense up to sparse_threshold bins. Above it, an open addressing hash
+// table over the global bin index, so that memory scales with the number
+// of occupied bins rather than with the product of all axes.
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+struct bin_t {
+  double w = 0, w2 = 0;
+  void operator++() noexcept {
+    ++w; ++w2;
+  }
+  void operator+=(double weight) noexcept {
+    w  += weight;
+    w2 += weight*weight;
+  }
+  bin_t& operator+=(const bin_t& b) noexcept {
+    w  += b.w;
+    w2 += b.w2;
+    return *this;
+  }
+};
+
+class hist {
+  static constexpr uint64_t empty = -1;
+
+  size_t _nbins, nw;
+  bool _sparse;
+  std::vector<bin_t> bins; // [bin or slot][weight]
+  std::vector<uint64_t> keys; // bin index of each slot, if sparse
+  size_t nused = 0;
+  unsigned shift = 64;
+
+  size_t slot(uint64_t bin) const noexcept { // fibonacci hashing
+    return (bin * 0x9E3779B97F4A7C15ull) >> shift;
+  }
+  void rehash(size_t nslots) {
+    std::vector<uint64_t> old_keys(nslots,empty);
+    std::vector<bin_t> old_bins(nslots*nw);
+    keys.swap(old_keys);
+    bins.swap(old_bins);
+    for (shift = 64; nslots > 1; nslots >>= 1) --shift;
+    for (size_t i=0; i<old_keys.size(); ++i) {
+      if (old_keys[i]==empty) continue;
+      size_t j = slot(old_keys[i]);
+      while (keys[j]!=empty) j = (j+1) & (keys.size()-1);
+      keys[j] = old_keys[i];
+      std::copy_n(&old_bins[i*nw],nw,&bins[j*nw]);
+    }
+  }
+
+public:
+  static constexpr size_t sparse_threshold = 1 << 20;
+
+  hist(size_t nbins, size_t nweights)
+  : _nbins(nbins), nw(nweights), _sparse(nbins > sparse_threshold)
+  {
+    if (_sparse) rehash(1 << 10);
+    else bins.resize(nbins*nw);
+  }
+
+  size_t nbins() const noexcept { return _nbins; }
+  size_t nweights() const noexcept { return nw; }
+  bool sparse() const noexcept { return _sparse; }
+  size_t size() const noexcept { return _sparse ? nused : _nbins; }
+
+  // bins of all weights for the global bin index
+  bin_t* operator[](uint64_t bin) {
+    if (!_sparse) return &bins[bin*nw];
+    for (size_t i = slot(bin); ; i = (i+1) & (keys.size()-1)) {
+      if (keys[i]==bin) return &bins[i*nw];
+      if (keys[i]==empty) {
+        if (2*(nused+1) > keys.size()) {
+          rehash(keys.size()*2);
+          return (*this)[bin];
+        }
+        keys[i] = bin;
+        ++nused;
+        return &bins[i*nw];
+      }
+    }
+  }
+
+  // calls f(bin index, bins of all weights)
+  // for all bins if dense, for occupied bins in no particular order if sparse
+  template <typename F>
+  void for_each(F&& f) const {
+    if (!_sparse)
+      for (size_t b=0; b<_nbins; ++b) f(uint64_t(b),&bins[b*nw]);
+    else
+      for (size_t i=0; i<keys.size(); ++i)
+        if (keys[i]!=empty) f(keys[i],&bins[i*nw]);
+  }
+  // same, in order of bin index
+  template <typename F>
+  void for_each_sorted(F&& f) const {
+    if (!_sparse) return for_each(f);
+    std::vector<size_t> slots;
+    slots.reserve(nused);
+    for (size_t i=0; i<keys.size(); ++i)
+      if (keys[i]!=empty) slots.push_back(i);
+    std::sort(slots.begin(),slots.end(),
+      [&](size_t a, size_t b){ return keys[a] < keys[b]; });
+    for (size_t i : slots) f(keys[i],&bins[i*nw]);
+  }
+
+  hist& operator+=(const hist& h) {
+    h.for_each([&](uint64_t b, const bin_t* x){
+      bin_t* y = (*this)[b];
+      for (size_t k=0; k<nw; ++k) y[k] += x[k];
+    });
+    return *this;
+  }
+};
+
+#endif
@@ -0,0 +1,362 @@
+#ifndef HIST_IO_HH
+#define HIST_IO_HH
+
+// output of bin2 histograms, see hist.hh
+//
+// JSON is formatted with std::to_chars into a buffer, which is written
+// in large chunks.
+//
+// .bin files are little endian, with all fields 8 byte aligned,
+// so that a reader can mmap the file and use the arrays in place:
+//   "hbin" u32 version
+//   u32 flags (1: sparse), u32 nvars
+//   f64 lumi, u64 nbins, u64 nhists
+//   nvars  x { u64 len, name padded to 8, u64 nedges, f64 edges[nedges] }
+//   nhists x { u64 len, name padded to 8, u64 n,
+//              [u64 bin[n] if sparse], f64 w[n], f64 w2[n] }
+//   u64 ninputs
+//   ninputs x { u64 len, name padded to 8,
+//               u64 is_mc, u64 size, u64 nevents, f64 lumi, u64 hash }
+// n is nbins if dense, the number of occupied bins if sparse,
+// bin is the global bin index, in increasing order
+// hists are data, mc, the mc weight variations, then the bootstrap
+// replicas data/boot/r and mc/boot/r, if any
+// inputs are the .dat files that were binned, version 1 has none,
+// version 2 has no hash
+//
+// A .bin file is the complete state of the histograms, so that new inputs
+// can be added to it, and files from separate runs merged.
+
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+
+#include <nlohmann/json.hpp>
+#include "ivanp/error.hh"
+#include "hist.hh"
+
+constexpr char hist_bin_magic[4] = {'h','b','i','n'};
+constexpr uint32_t hist_bin_version = 3;
+
+class out_buffer {
+  std::string name, buf;
+  std::ofstream f;
+
+public:
+  out_buffer(const std::string& name)
+  : name(name), f(name, std::ios::binary) {
+    if (!f) throw ivanp::error("cannot open \"",name,'\"');
+    buf.reserve(1 << 20);
+  }
+
+  void flush() {
+    f.write(buf.data(),buf.size());
+    buf.clear();
+  }
+  void close() {
+    flush();
+    f.close();
+    if (!f) throw ivanp::error("failed to write \"",name,'\"');
+  }
+
+  out_buffer& operator<<(std::string_view s) {
+    buf.append(s);
+    if (buf.size() >= (1 << 20)) flush();
+    return *this;
+  }
+  out_buffer& operator<<(char c) {
+    buf += c;
+    return *this;
+  }
+  // same digits as the default ostream format, %g
+  out_buffer& operator<<(double x) {
+    char s[32];
+    return *this << std::string_view(s,
+      std::to_chars(s,s+sizeof(s),x,std::chars_format::general,6).ptr - s);
+  }
+  out_buffer& operator<<(uint64_t x) {
+    char s[24];
+    return *this << std::string_view(s,
+      std::to_chars(s,s+sizeof(s),x).ptr - s);
+  }
+
+  // quoted and escaped, for names that come from the user
+  out_buffer& quoted(const std::string& s) {
+    return *this << nlohmann::json(s).dump();
+  }
+
+  template <typename T>
+  out_buffer& raw(const T& x) {
+    return *this << std::string_view(reinterpret_cast<const char*>(&x),
+                                     sizeof(x));
+  }
+  out_buffer& raw_name(std::string_view s) { // length, padded to 8 bytes
+    raw(uint64_t(s.size()));
+    *this << s;
+    for (size_t i=s.size(); i%8; ++i) *this << '\0';
+    return *this;
+  }
+};
+
+// a binned .dat file
+// name is the canonical path, - for streams, which are never the same
+// hash is of the file's header and index, see input_of() in bin2,
+// 0 if unknown, as in version 2 files
+struct hist_input {
+  std::string name;
+  uint64_t is_mc, size, nevents;
+  double lumi;
+  uint64_t hash = 0;
+
+  // the same events, possibly under another name
+  bool same_content(const hist_input& o) const noexcept {
+    return name!="-" && o.name!="-" && is_mc==o.is_mc &&
+      size==o.size && nevents==o.nevents &&
+      (hash && o.hash ? hash==o.hash : name==o.name);
+  }
+};
+
+struct hist_var { std::string name; std::vector<double> edges; };
+
+// contents of a .bin file, each histogram with a single weight
+struct hist_file {
+  float lumi = 0;
+  size_t nbins = 0;
+  std::vector<hist_var> vars;
+  std::vector<std::pair<std::string,hist>> hists;
+  std::vector<hist_input> inputs;
+
+  hist_file(const std::string& fname) {
+    std::ifstream f(fname, std::ios::binary);
+    if (!f) throw ivanp::error("cannot open \"",fname,'\"');
+    const std::string buf { std::istreambuf_iterator<char>(f), { } };
+    const char *p = buf.data(), *const end = p + buf.size();
+    auto get = [&](auto& x){
+      if (size_t(end-p) < sizeof(x))
+        throw ivanp::error("\"",fname,"\" is truncated");
+      memcpy(&x,p,sizeof(x));
+      p += sizeof(x);
+    };
+    auto u64 = [&]{ uint64_t x; get(x); return x; };
+    auto name = [&]{
+      const uint64_t n = u64();
+      if (uint64_t(end-p) < n)
+        throw ivanp::error("\"",fname,"\" is truncated");
+      std::string s(p,n);
+      p += (n+7)/8*8;
+      return s;
+    };
+
+    if (buf.size() < 8 || memcmp(p,hist_bin_magic,4))
+      throw ivanp::error("\"",fname,"\" is not a histogram .bin file");
+    p += 4;
+    uint32_t version, flags, nvars;
+    get(version);
+    if (version < 1 || version > hist_bin_version)
+      throw ivanp::error("\"",fname,"\" has unknown version ",version);
+    get(flags);
+    get(nvars);
+    double l;
+    get(l);
+    lumi = l;
+    nbins = u64();
+    const uint64_t nhists = u64();
+    for (uint32_t i=0; i<nvars; ++i) {
+      auto& var = vars.emplace_back();
+      var.name = name();
+      var.edges.resize(u64());
+      for (double& x : var.edges) get(x);
+    }
+    for (uint64_t i=0; i<nhists; ++i) {
+      auto& [hname, h] = hists.emplace_back(name(), hist(nbins,1));
+      if (bool(flags & 1) != h.sparse())
+        throw ivanp::error("\"",fname,"\": unexpected storage");
+      const uint64_t n = u64();
+      const unsigned narrays = h.sparse() ? 3 : 2;
+      if (n > nbins || uint64_t(end-p) < 8*narrays*n)
+        throw ivanp::error("\"",fname,"\" is truncated");
+      const char* const bins = p;
+      const char *const w = p + 8*n*(narrays-2), *const w2 = w + 8*n;
+      p = w2 + 8*n;
+      for (uint64_t j=0; j<n; ++j) {
+        uint64_t b = j;
+        if (h.sparse()) memcpy(&b,bins+8*j,8);
+        if (b >= nbins) throw ivanp::error("\"",fname,"\": bad bin index");
+        bin_t* x = h[b];
+        memcpy(&x->w,w+8*j,8);
+        memcpy(&x->w2,w2+8*j,8);
+      }
+    }
+    if (version > 1) {
+      inputs.resize(u64());
+      for (auto& in : inputs) {
+        in.name = name();
+        in.is_mc = u64();
+        in.size = u64();
+        in.nevents = u64();
+        get(in.lumi);
+        if (version > 2) in.hash = u64();
+      }
+    }
+  }
+};
+
+// results of one binning
+struct hist_output {
+  struct weight { std::string name; hist* h; unsigned k; };
+
+  float lumi = 0;
+  size_t nbins = 1;
+  std::vector<hist_var> vars;
+  std::vector<weight> hists; // data, mc, mc weight variations, replicas
+  std::vector<hist_input> inputs;
+
+  // add the histograms and inputs of a saved state
+  void add(const hist_file& f, const std::string& fname) {
+    bool same = f.nbins==nbins && f.vars.size()==vars.size() &&
+                f.hists.size()==hists.size();
+    for (size_t i=0; same && i<vars.size(); ++i)
+      same = f.vars[i].name==vars[i].name && f.vars[i].edges==vars[i].edges;
+    for (size_t i=0; same && i<hists.size(); ++i)
+      same = f.hists[i].first==hists[i].name;
+    if (!same) throw ivanp::error(
+      "\"",fname,"\" has different binning or weights");
+    for (const auto& in : f.inputs)
+      for (const auto& in2 : inputs)
+        if (in.same_content(in2)) throw ivanp::error(
+          "\"",in.name,"\" is included twice, again in \"",fname,'\"');
+        else if (in.name==in2.name && in.name!="-") throw ivanp::error(
+          "\"",in.name,"\" has different content in \"",fname,'\"');
+    for (size_t i=0; i<hists.size(); ++i) {
+      const auto& hw = hists[i];
+      f.hists[i].second.for_each([&](uint64_t b, const bin_t* x){
+        (*hw.h)[b][hw.k] += *x;
+      });
+    }
+    inputs.insert(inputs.end(),f.inputs.begin(),f.inputs.end());
+  }
+
+  bool sparse() const noexcept { return nbins > hist::sparse_threshold; }
+
+  // binary if the name ends in .bin, JSON otherwise
+  void write(const std::string& fname) const {
+    if (fname.size() > 4 && !fname.compare(fname.size()-4,4,".bin"))
+      write_bin(fname);
+    else
+      write_json(fname);
+  }
+
+  void write_json(const std::string& fname) const {
+    out_buffer out(fname);
+    out << "{\"lumi\": " << double(lumi) << ",\n";
+    out << "\"bins\":[\n";
+    bool first = true;
+    for (const auto& var : vars) {
+      if (!first) out << ",\n";
+      out << '[';
+      out.quoted(var.name) << ",[\n";
+      first = true;
+      for (double x : var.edges) {
+        if (first) first = false;
+        else out << ',';
+        out << x;
+      }
+      out << "\n]]";
+    }
+    out << '\n';
+    // dense: [w,err] for every bin
+    // sparse: [bin,w,err] for occupied bins, bin is the global index
+    auto write_bins = [&](const weight& hw){
+      out << "[\n";
+      bool first = true;
+      hw.h->for_each_sorted([&](uint64_t b, const bin_t* x){
+        if (first) first = false;
+        else out << ",\n";
+        out << '[';
+        if (hw.h->sparse()) out << b << ',';
+        out << x[hw.k].w << ',' << std::sqrt(x[hw.k].w2) << ']';
+      });
+      out << "\n]";
+    };
+    if (sparse())
+      out << "],\n\"sparse\": true,\n\"nbins\": " << uint64_t(nbins);
+    else out << ']';
+    auto is_replica = [](const weight& hw){
+      return hw.name.find("/boot/") != std::string::npos;
+    };
+    size_t nvar = 0;
+    for (size_t i=0; i<hists.size(); ++i) {
+      if (is_replica(hists[i])) continue;
+      if (i < 2) out << ",\n";
+      else out << (nvar++ ? ",\n" : ",\n\"mc_weights\":{\n");
+      out.quoted(hists[i].name) << ':';
+      write_bins(hists[i]);
+    }
+    if (nvar) out << "\n}";
+    // bootstrap: {"data":[replicas],"mc":[replicas]}
+    bool boot = false;
+    for (const char* sample : {"data","mc"}) {
+      const std::string prefix = std::string(sample) + "/boot/";
+      size_t n = 0;
+      for (const auto& hw : hists) {
+        if (hw.name.compare(0,prefix.size(),prefix)) continue;
+        if (!n++) {
+          out << (boot ? "]," : ",\n\"bootstrap\":{");
+          out << "\n\"" << sample << "\":[";
+          boot = true;
+        } else out << ',';
+        out << '\n';
+        write_bins(hw);
+      }
+    }
+    if (boot) out << "]}";
+    out << "\n}";
+    out.close();
+  }
+
+  void write_bin(const std::string& fname) const {
+    out_buffer out(fname);
+    out << std::string_view(hist_bin_magic,4);
+    out.raw(hist_bin_version);
+    out.raw(uint32_t(sparse()));
+    out.raw(uint32_t(vars.size()));
+    out.raw(double(lumi));
+    out.raw(uint64_t(nbins));
+    out.raw(uint64_t(hists.size()));
+    for (const auto& var : vars) {
+      out.raw_name(var.name);
+      out.raw(uint64_t(var.edges.size()));
+      for (double x : var.edges) out.raw(x);
+    }
+    for (const auto& hw : hists) {
+      out.raw_name(hw.name);
+      out.raw(uint64_t(hw.h->size()));
+      if (hw.h->sparse())
+        hw.h->for_each_sorted([&](uint64_t b, const bin_t*){ out.raw(b); });
+      hw.h->for_each_sorted([&](uint64_t, const bin_t* x){
+        out.raw(x[hw.k].w);
+      });
+      hw.h->for_each_sorted([&](uint64_t, const bin_t* x){
+        out.raw(x[hw.k].w2);
+      });
+    }
+    out.raw(uint64_t(inputs.size()));
+    for (const auto& in : inputs) {
+      out.raw_name(in.name);
+      out.raw(in.is_mc);
+      out.raw(in.size);
+      out.raw(in.nevents);
+      out.raw(in.lumi);
+      out.raw(in.hash);
+    }
+    out.close();
+  }
+};
+
+#endif
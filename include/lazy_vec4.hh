@@ -0,0 +1,93 @@
+#ifndef LAZY_VEC4_HH
+#define LAZY_VEC4_HH
+
+// 4-vectors viewed as stored pt eta phi m floats
+// ivanp::vec4 is only built when a variable needs more than
+// the stored components, so most variables need no trig
+
+#include <cstring>
+#include "ivanp/math/vec4.hh"
+
+class lazy_vec4 {
+  const char* p = nullptr;
+  mutable ivanp::vec4<> v;
+  mutable bool built = false;
+
+  float get(unsigned i) const noexcept {
+    float x;
+    memcpy(&x,p+sizeof(float)*i,sizeof(float));
+    return x;
+  }
+
+public:
+  lazy_vec4& operator=(const char* raw) noexcept {
+    p = raw;
+    built = false;
+    return *this;
+  }
+
+  double pt () const noexcept { return get(0); }
+  double eta() const noexcept { return get(1); }
+  double phi() const noexcept { return get(2); }
+  double m  () const noexcept { return get(3); }
+  double rap() const noexcept { return vec().rap(); }
+
+  const ivanp::vec4<>& vec() const noexcept {
+    if (!built) {
+      float mom[4];
+      memcpy(mom,p,sizeof(mom));
+      v = { mom, ivanp::vec4<>::PtEtaPhiM };
+      built = true;
+    }
+    return v;
+  }
+  operator const ivanp::vec4<>&() const noexcept { return vec(); }
+};
+
+// sum of two lazy_vec4, built on first use after reset
+class lazy_sum {
+  const lazy_vec4 &a, &b;
+  mutable ivanp::vec4<> v;
+  mutable bool built = false;
+
+public:
+  lazy_sum(const lazy_vec4& a, const lazy_vec4& b) noexcept: a(a), b(b) { }
+  void reset() noexcept { built = false; }
+
+  const ivanp::vec4<>& vec() const noexcept {
+    if (!built) {
+      v = a.vec() + b.vec();
+      built = true;
+    }
+    return v;
+  }
+  operator const ivanp::vec4<>&() const noexcept { return vec(); }
+
+  double pt () const noexcept { return vec().pt(); }
+  double eta() const noexcept { return vec().eta(); }
+  double phi() const noexcept { return vec().phi(); }
+  double m  () const noexcept { return vec().m(); }
+  double rap() const noexcept { return vec().rap(); }
+};
+
+// the stored jets of an event
+struct lazy_jets {
+  lazy_vec4 v[4];
+  unsigned n = 0;
+
+  const lazy_vec4& operator[](unsigned i) const noexcept { return v[i]; }
+  const lazy_vec4* begin() const noexcept { return v; }
+  const lazy_vec4* end() const noexcept { return v+n; }
+};
+
+inline ivanp::vec4<> operator+(const lazy_vec4& a, const lazy_vec4& b) {
+  return a.vec() + b.vec();
+}
+inline ivanp::vec4<> operator+(const lazy_sum& a, const lazy_vec4& b) {
+  return a.vec() + b.vec();
+}
+inline ivanp::vec4<>& operator+=(ivanp::vec4<>& a, const lazy_vec4& b) {
+  return a += b.vec();
+}
+
+#endif
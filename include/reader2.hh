@@ -1,31 +1,682 @@
 #ifndef READER2_HH
 #define READER2_HH
 
+// hgam .dat files
+//
+// record: [weights (mc only)] [pt eta phi m]x2 [njets] [pt eta phi m]x(<=4)
+//         floats, njets is uint8_t and counts all jets, at most 4 are stored
+//         mc has 1 weight, or nweights if the weights flag is set
+//
+// v2: 'd' lumi nevents records... | 'm' nevents records...
+// v3: header: "hgm3" dm flags lumi block_size
+//             [nweights {len name}x(nweights) if weights flag]
+//             [len schema if schema flag, see schema.hh]
+//             [padding to 4 bytes if columnar]
+//     blocks: nevents nbytes [raw_nbytes if compressed] payload
+//             [empty block if end_marker flag]
+//     index:  uint64_t offset of every block
+//     footer: index_pos nblocks nevents "hgm3"
+//     every block, except possibly the last, has block_size events
+//
+// v3 block payload:
+//   rows:     records...
+//   columnar: njets_stored weights[nweights][n] y[2][4][n]
+//             jets[4][njets_stored] njets[n] padding
+//             float columns are 4 byte aligned in the file
+//   compressed: see codec.hh, stored as is if nbytes == raw_nbytes
+//               written only for columnar blocks
+//
+// event index sidecar, <file>.idx, for v2 files, written by index2:
+//   "hgix" stride nevents file_size offset of every stride-th event
+//   v3 files have the block index instead
+//
+// v3 files with the end_marker flag can be read as a stream,
+// from stdin as "-" or from a FIFO, see writer2.hh
+
 #include <cstring>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <fstream>
+#include <algorithm>
+#include <memory>
+#include <future>
+#include <cerrno>
+#include <glob.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <vector>
+#include <type_traits>
 #include "ivanp/io/mem_file.hh"
-#include "ivanp/math/vec4.hh"
+#include "ivanp/error.hh"
+#include "codec.hh"
+#include "schema.hh"
 
-class reader {
-  ivanp::mem_file f;
-  const char *pos, *end;
+constexpr char hgam_v3_magic[4] = {'h','g','m','3'};
+constexpr size_t hgam_v3_header_size = 4+1+1+4+4;
+constexpr size_t hgam_v3_footer_size = 8+4+4+4;
+constexpr uint32_t hgam_default_block_size = 1 << 14;
+constexpr char hgam_index_magic[4] = {'h','g','i','x'};
+constexpr uint32_t hgam_default_index_stride = 1 << 12;
 
-public:
-  reader(const char* filename)
-  : f(ivanp::mem_file::mmap(filename)), pos(f.mem()), end(pos+f.size()) { }
+enum hgam_flags : uint8_t {
+  hgam_columnar = 1,
+  hgam_compressed = 2,
+  hgam_weights = 4,
+  hgam_schema = 8,
+  hgam_end_marker = 16
+};
+
+struct hgam_format {
+  bool columnar = false, compressed = false;
+  uint32_t block_size = hgam_default_block_size;
+  std::vector<std::string> weights; // names, mc only, empty for 1 weight
+
+  unsigned nweights(bool is_mc) const noexcept {
+    return is_mc ? (weights.empty() ? 1 : weights.size()) : 0;
+  }
+};
+
+// records are decoded with the hgam decoder of schema.hh
+using hgam_decoder = dat_decoder<dat_schema::hgam>;
+
+inline size_t record_size(const char* rec, unsigned nweights) noexcept {
+  return hgam_decoder{nweights}.skip(rec) - rec;
+}
 
-  operator bool() const noexcept { return pos != end; }
+// one block of events as columns
+struct hgam_columns {
+  uint32_t n = 0, njets_stored = 0;
+  std::vector<const float*> weight; // empty for data
+  const float* y[2][4];
+  const float* jets[4]; // jets of all events, at most 4 per event
+  const uint8_t* njets;
+};
+
+// owning columns, used to transpose rows
+struct hgam_column_buffer {
+  std::vector<std::vector<float>> weight;
+  std::vector<float> y[2][4], jets[4];
+  std::vector<uint8_t> njets;
+
+  void clear(unsigned nweights) {
+    weight.resize(nweights);
+    for (auto& c : weight) c.clear();
+    for (auto& p : y) for (auto& c : p) c.clear();
+    for (auto& c : jets) c.clear();
+    njets.clear();
+  }
+
+  // decode one record
+  const char* add(const char* rec) {
+    hgam_event e;
+    rec = hgam_decoder{unsigned(weight.size())}(rec,e);
+    for (size_t i=0; i<weight.size(); ++i) weight[i].push_back(e.weight(i));
+    for (int i=0; i<2; ++i)
+      for (int j=0; j<4; ++j) y[i][j].push_back(e.get(e.y[i],j));
+    njets.push_back(e.njets);
+    for (unsigned k=0; k<e.njets_stored; ++k)
+      for (int j=0; j<4; ++j) jets[j].push_back(e.get(e.jet(k),j));
+    return rec;
+  }
 
-  void skip(size_t len) { pos += len; }
+  hgam_columns view() const {
+    hgam_columns c;
+    c.n = njets.size();
+    c.njets_stored = jets[0].size();
+    for (const auto& w : weight) c.weight.push_back(w.data());
+    for (int i=0; i<2; ++i)
+      for (int j=0; j<4; ++j) c.y[i][j] = y[i][j].data();
+    for (int j=0; j<4; ++j) c.jets[j] = jets[j].data();
+    c.njets = njets.data();
+    return c;
+  }
+};
+
+inline size_t columnar_payload_size(
+  uint32_t n, uint32_t njets_stored, unsigned nweights
+) noexcept {
+  const size_t size = sizeof(uint32_t) + sizeof(float)*(
+    nweights*n + 8*n + 4*njets_stored ) + n;
+  return (size + 3) & ~size_t(3);
+}
+
+class reader {
+  std::unique_ptr<ivanp::mem_file> f; // not for streams
+  const char *mem, *mem_end; // mapped file or stream header
+  const char *pos, *end, *data_begin;
+  const char *blk = nullptr, *blk_end = nullptr, *index = nullptr; // v3
+  const char *range_end_pos; // v2
+  uint32_t _nevents = 0, _nblocks = 0;
+  uint32_t _begin, _end; // event range
+  uint32_t blk_first = 0, next_first = 0; // v3 block and next event
+  uint32_t stride = 0; // v2 sidecar
+  std::vector<uint64_t> offsets;
+  float _lumi = 0;
+  bool _is_mc;
+  unsigned _version, _nweights;
+  hgam_decoder decode { 0 };
+  hgam_format _format;
+  std::unique_ptr<dat_schema> _schema; // v3 with schema flag
+  std::vector<char> rows; // transposed columnar block
+  hgam_column_buffer cols; // transposed rows
+  std::vector<char> raw, tmp; // decompressed block
+  int fd = -1; // stream
+  std::vector<char> head, sbuf[2]; // stream header and blocks
+  std::future<bool> pending; // next stream block, read ahead
+  // only used by read_block, published after pending.get()
+  uint32_t stream_nevents = 0, stream_nblocks = 0;
 
   template <typename T>
-  T& operator()(T& x) {
-    memcpy(&x,pos,sizeof(T));
-    pos += sizeof(T);
+  static T get(const char*& p) noexcept {
+    T x;
+    memcpy(&x,p,sizeof(T));
+    p += sizeof(T);
     return x;
   }
-  ivanp::vec4<>& operator()(ivanp::vec4<>& x) {
-    float mom[4];
-    return x = { operator()(mom), ivanp::vec4<>::PtEtaPhiM_t{} };
+
+  // advance to the next v3 block with events in range
+  // events [k0,k1) of the block's n are to be read
+  bool next_block_raw(
+    const char*& payload, uint32_t& n, uint32_t& k0, uint32_t& k1
+  ) {
+    while (blk != blk_end || (fd >= 0 && next_stream_block())) {
+      n = get<uint32_t>(blk);
+      const uint32_t nbytes = get<uint32_t>(blk);
+      const uint32_t raw_nbytes =
+        _format.compressed ? get<uint32_t>(blk) : nbytes;
+      payload = blk;
+      blk += nbytes;
+      const uint32_t first = blk_first;
+      blk_first += n;
+      if (first >= _end || next_first >= _end) break;
+      if (blk_first <= next_first) continue;
+      k0 = next_first > first ? next_first - first : 0;
+      k1 = std::min(_end,blk_first) - first;
+      next_first = blk_first;
+      if (nbytes != raw_nbytes) {
+        block_decompress(payload,nbytes,raw,raw_nbytes,tmp);
+        payload = raw.data();
+      } else if (_format.columnar &&
+                 reinterpret_cast<uintptr_t>(payload)%4) {
+        raw.assign(payload,payload+nbytes); // align columns
+        payload = raw.data();
+      }
+      return true;
+    }
+    blk = blk_end;
+    return false;
+  }
+
+  static unsigned stored(uint8_t njets) noexcept {
+    return njets>4 ? 4 : njets;
+  }
+
+  hgam_columns columns_view(
+    const char* p, uint32_t n, uint32_t k0, uint32_t k1
+  ) const {
+    hgam_columns c;
+    c.njets_stored = get<uint32_t>(p);
+    auto col = [&](auto*& x, size_t len){
+      x = reinterpret_cast<std::remove_reference_t<decltype(x)>>(p);
+      p += sizeof(*x)*len;
+    };
+    c.weight.resize(_nweights);
+    for (auto& x : c.weight) col(x,n);
+    for (auto& y : c.y) for (auto& x : y) col(x,n);
+    for (auto& x : c.jets) col(x,c.njets_stored);
+    col(c.njets,n);
+    c.n = n;
+    if (k0 || k1 != n) { // clip to the range
+      uint32_t j0 = 0, j1 = 0;
+      for (uint32_t i=0; i<k1; ++i) {
+        if (i==k0) j0 = j1;
+        j1 += stored(c.njets[i]);
+      }
+      for (auto& x : c.weight) x += k0;
+      for (auto& y : c.y) for (auto& x : y) x += k0;
+      for (auto& x : c.jets) x += j0;
+      c.njets += k0;
+      c.n = k1 - k0;
+      c.njets_stored = j1 - j0;
+    }
+    return c;
+  }
+
+  bool next_block() {
+    const char* payload;
+    uint32_t n, k0, k1;
+    if (!next_block_raw(payload,n,k0,k1)) return false;
+    if (_format.columnar) {
+      const auto c = columns_view(payload,n,k0,k1);
+      rows.clear();
+      auto put = [&](const auto& x){
+        const char* p = reinterpret_cast<const char*>(&x);
+        rows.insert(rows.end(),p,p+sizeof(x));
+      };
+      for (uint32_t i=0, j=0; i<c.n; ++i) {
+        for (auto* x : c.weight) put(x[i]);
+        for (auto& y : c.y) for (auto* x : y) put(x[i]);
+        put(c.njets[i]);
+        for (unsigned k=0, nj=stored(c.njets[i]); k<nj; ++k, ++j)
+          for (auto* x : c.jets) put(x[j]);
+      }
+      pos = rows.data();
+      end = pos + rows.size();
+    } else {
+      pos = payload;
+      end = payload == raw.data() ? pos + raw.size() : blk;
+      if (k0 || k1 != n) {
+        for (uint32_t i=0; i<k0; ++i) pos = decode.skip(pos);
+        end = pos;
+        for (uint32_t i=k0; i<k1; ++i) end = decode.skip(end);
+      }
+    }
+    return true;
+  }
+
+  // v2 position of event i
+  const char* v2_event(uint32_t i) const noexcept {
+    if (i >= _nevents) return mem_end;
+    const char* p = data_begin;
+    if (stride) {
+      p = mem + offsets[i/stride];
+      i %= stride;
+    }
+    for (; i; --i) p = decode.skip(p);
+    return p;
+  }
+
+  // false at the end of the stream, throws if it ends inside
+  bool read_exact(char* p, size_t n) {
+    for (size_t k=0; k<n; ) {
+      const ssize_t r = ::read(fd,p+k,n-k);
+      if (r < 0) {
+        if (errno==EINTR) continue;
+        throw ivanp::error("read: ",strerror(errno));
+      }
+      if (r==0) {
+        if (k) throw ivanp::error("unexpected end of stream");
+        return false;
+      }
+      k += r;
+    }
+    return true;
+  }
+
+  // stdin as "-", or a file that is not regular, e.g. a FIFO
+  // reads the header, so that it can be parsed as a mapped one
+  bool open_stream(const char* filename) {
+    if (strcmp(filename,"-")) {
+      struct stat sb;
+      if (::stat(filename,&sb) || S_ISREG(sb.st_mode)) return false;
+      fd = ::open(filename,O_RDONLY);
+      if (fd < 0) throw ivanp::error("cannot open \"",filename,'\"');
+    } else fd = 0;
+
+    auto more = [&](size_t n){
+      const size_t k = head.size();
+      head.resize(k+n);
+      if (!read_exact(head.data()+k,n)) throw ivanp::error(
+        "stream \"",filename,"\" ended in header");
+      return head.data()+k;
+    };
+    const uint8_t flags = more(hgam_v3_header_size)[5];
+    if (memcmp(head.data(),hgam_v3_magic,4)) return true;
+    if (flags & hgam_weights)
+      for (uint8_t n = *more(1); n; --n) more(uint8_t(*more(1)));
+    if (flags & hgam_schema) {
+      uint32_t len;
+      memcpy(&len,more(sizeof(len)),sizeof(len));
+      more(len);
+    }
+    if (flags & hgam_columnar) more((4 - head.size()%4)%4);
+    return true;
+  }
+
+  // stream: read the next block into b, runs ahead of the consumer
+  // false at the end of blocks marker, after the footer is checked
+  bool read_block(std::vector<char>& b) {
+    const size_t hs = sizeof(uint32_t)*(_format.compressed ? 3 : 2);
+    b.resize(hs);
+    if (!read_exact(b.data(),hs))
+      throw ivanp::error("stream ended before the last block");
+    const char* p = b.data();
+    const uint32_t n = get<uint32_t>(p);
+    const uint32_t nbytes = get<uint32_t>(p);
+    if (!n && !nbytes) { // index and footer follow
+      b.clear();
+      for (size_t k=0; ; ) {
+        b.resize(k + (1<<16));
+        const ssize_t r = ::read(fd,b.data()+k,b.size()-k);
+        if (r < 0 && errno==EINTR) continue;
+        if (r < 0) throw ivanp::error("read: ",strerror(errno));
+        if (r==0) { b.resize(k); break; }
+        k += r;
+      }
+      if (b.size() < hgam_v3_footer_size ||
+          memcmp(b.data()+b.size()-4,hgam_v3_magic,4))
+        throw ivanp::error("stream has no v3 footer");
+      p = b.data() + b.size() - hgam_v3_footer_size + sizeof(uint64_t);
+      stream_nblocks = get<uint32_t>(p);
+      const uint32_t nevents = get<uint32_t>(p);
+      if (nevents != stream_nevents) throw ivanp::error(
+        "stream has ",stream_nevents," events, footer says ",nevents);
+      return false;
+    }
+    stream_nevents += n;
+    b.resize(hs+nbytes);
+    if (!read_exact(b.data()+hs,nbytes))
+      throw ivanp::error("unexpected end of stream");
+    return true;
+  }
+
+  // double buffering: the next block is read while this one is used
+  bool next_stream_block() {
+    if (!pending.valid()) return false;
+    if (!pending.get()) { // the footer is read
+      _nblocks = stream_nblocks;
+      _nevents = stream_nevents;
+      return false;
+    }
+    std::swap(sbuf[0],sbuf[1]);
+    blk = sbuf[0].data();
+    blk_end = blk + sbuf[0].size();
+    pending = std::async(std::launch::async,
+      &reader::read_block, this, std::ref(sbuf[1]));
+    return true;
+  }
+
+  // v2 event index sidecar, ignored if it does not match the file
+  void read_sidecar(const char* filename) {
+    std::ifstream idx(ivanp::cat(filename,".idx"), std::ios::binary);
+    if (!idx) return;
+    char magic[4];
+    uint32_t s, n;
+    uint64_t size;
+    idx.read(magic,4);
+    idx.read(reinterpret_cast<char*>(&s),sizeof(s));
+    idx.read(reinterpret_cast<char*>(&n),sizeof(n));
+    idx.read(reinterpret_cast<char*>(&size),sizeof(size));
+    if (!idx || memcmp(magic,hgam_index_magic,4) || !s ||
+        n != _nevents || size != size_t(mem_end - mem)) return;
+    offsets.resize(n ? (n-1)/s + 1 : 0);
+    idx.read(reinterpret_cast<char*>(offsets.data()),
+             sizeof(uint64_t)*offsets.size());
+    if (!idx) { offsets.clear(); return; }
+    for (auto x : offsets)
+      if (x < size_t(data_begin - mem) || x >= size) {
+        offsets.clear(); return;
+      }
+    stride = s;
+  }
+
+public:
+  // read events [event_begin, event_end) of the file
+  reader(const char* filename,
+         uint32_t event_begin = 0, uint32_t event_end = uint32_t(-1))
+  {
+    if (open_stream(filename)) {
+      mem = head.data();
+      mem_end = mem + head.size();
+    } else {
+      f.reset(new ivanp::mem_file(ivanp::mem_file::mmap(filename)));
+      mem = f->mem();
+      mem_end = mem + f->size();
+    }
+    pos = mem;
+    end = mem_end;
+    const size_t size = end - pos;
+    if (size >= hgam_v3_header_size +
+                (fd < 0 ? hgam_v3_footer_size : 0) &&
+        !memcmp(pos,hgam_v3_magic,4))
+    {
+      _version = 3;
+      pos += 4;
+      const char dm = get<char>(pos);
+      if (dm!='d' && dm!='m') throw ivanp::error(
+        "file \"",filename,"\" has type \'",dm,"\' instead of \'d\' or \'m\'");
+      _is_mc = dm=='m';
+      const uint8_t flags = get<uint8_t>(pos);
+      if (flags & ~(hgam_columnar|hgam_compressed|hgam_weights|
+                    hgam_schema|hgam_end_marker))
+        throw ivanp::error(
+          "file \"",filename,"\" has unsupported format flags");
+      _format.columnar = flags & hgam_columnar;
+      _format.compressed = flags & hgam_compressed;
+      _lumi = get<float>(pos);
+      _format.block_size = get<uint32_t>(pos);
+      if (flags & hgam_weights) {
+        _format.weights.resize(get<uint8_t>(pos));
+        for (auto& name : _format.weights) {
+          const uint8_t len = get<uint8_t>(pos);
+          name.assign(pos,len);
+          pos += len;
+        }
+      }
+      if (flags & hgam_schema) {
+        const uint32_t len = get<uint32_t>(pos);
+        _schema = std::make_unique<dat_schema>(pos,pos+len);
+        if (_schema->layout != dat_schema::hgam ||
+            _schema->weights.size() != _format.nweights(_is_mc))
+          throw ivanp::error(
+            "file \"",filename,"\" header does not match its schema");
+      }
+      if (_format.columnar)
+        while ((pos - mem) % 4) ++pos;
+
+      if (fd >= 0) {
+        if (!(flags & hgam_end_marker)) throw ivanp::error(
+          "file \"",filename,"\" has no end of blocks marker"
+          " and cannot be read as a stream");
+        blk = blk_end = nullptr;
+        pending = std::async(std::launch::async,
+          &reader::read_block, this, std::ref(sbuf[1]));
+      } else {
+        const char* foot = end - hgam_v3_footer_size;
+        if (memcmp(end-4,hgam_v3_magic,4)) throw ivanp::error(
+          "file \"",filename,"\" has no v3 footer, incomplete file?");
+        const uint64_t index_pos = get<uint64_t>(foot);
+        _nblocks = get<uint32_t>(foot);
+        _nevents = get<uint32_t>(foot);
+        index = mem + index_pos;
+        blk = pos;
+        blk_end = index;
+      }
+      end = pos;
+    } else if (size && (*pos=='d' || *pos=='m')) {
+      if (fd >= 0) throw ivanp::error(
+        "v2 file \"",filename,"\" cannot be read as a stream");
+      _version = 2;
+      _is_mc = get<char>(pos)=='m';
+      if (!_is_mc) _lumi = get<float>(pos);
+      _nevents = get<uint32_t>(pos);
+    } else throw ivanp::error(
+      "file \"",filename,"\" is not an hgam .dat file");
+    _nweights = _format.nweights(_is_mc);
+    decode = { _nweights };
+    data_begin = pos;
+    range_end_pos = end;
+
+    _end = fd < 0 ? std::min(event_end,_nevents) : event_end;
+    _begin = std::min(event_begin,_end);
+    if (_version==2) {
+      read_sidecar(filename);
+      if (_end < _nevents) range_end_pos = v2_event(_end);
+    }
+    if (fd < 0) seek(_begin);
+    else next_first = _begin;
+  }
+  ~reader() {
+    if (pending.valid()) pending.wait();
+    if (fd > 0) ::close(fd);
+  }
+
+  bool is_mc() const noexcept { return _is_mc; }
+  float lumi() const noexcept { return _lumi; }
+  // in the file, known for streams only once they are read
+  uint32_t nevents() const noexcept { return _nevents; }
+  bool is_stream() const noexcept { return fd >= 0; }
+  // events are found without a scan, so ranges are cheap
+  bool indexed() const noexcept { return fd < 0 && (_version==3 || stride); }
+  uint32_t event_begin() const noexcept { return _begin; }
+  uint32_t event_end() const noexcept { return _end; }
+  unsigned version() const noexcept { return _version; }
+  const hgam_format& format() const noexcept { return _format; }
+  unsigned nweights() const noexcept { return _nweights; }
+  uint32_t nblocks() const noexcept { return _nblocks; }
+  uint32_t block_size() const noexcept { return _format.block_size; }
+  const dat_schema* schema() const noexcept { return _schema.get(); }
+
+  // bytes that identify the content of a mapped file, without reading it:
+  // the header, and the block index and footer,
+  // or the last records for v2; empty for streams
+  std::string_view header_bytes() const noexcept {
+    if (fd >= 0) return { };
+    return { mem, size_t(data_begin-mem) };
+  }
+  std::string_view tail_bytes() const noexcept {
+    if (fd >= 0) return { };
+    const char* a = _version==3 ? index
+      : mem_end - std::min<size_t>(mem_end-data_begin,1 << 12);
+    return { a, size_t(mem_end-a) };
+  }
+
+  operator bool() { return pos != end || next_block(); }
+
+  void skip_events(uint32_t n) {
+    for (; n && *this; --n) pos = decode.skip(pos);
+  }
+
+  // position at the beginning of event i, within the range
+  void seek(uint32_t i) {
+    if (fd >= 0) throw ivanp::error("cannot seek in a stream");
+    i = std::clamp(i,_begin,_end);
+    if (_version==3) {
+      const uint32_t bs = _format.block_size;
+      const uint32_t b = bs ? i/bs : 0;
+      end = pos;
+      next_first = i;
+      if (b >= _nblocks) { blk = blk_end; return; }
+      const char* p = index + sizeof(uint64_t)*b;
+      blk = mem + get<uint64_t>(p);
+      blk_first = b*bs;
+    } else {
+      pos = v2_event(i);
+      end = range_end_pos;
+    }
+  }
+
+  // read the next block as columns
+  // columnar files are not copied
+  // rows are read up to the end of the current block,
+  // or block_size events for v2
+  bool next(hgam_columns& c) {
+    if (_format.columnar) {
+      const char* payload;
+      uint32_t n, k0, k1;
+      pos = end;
+      if (!next_block_raw(payload,n,k0,k1)) return false;
+      c = columns_view(payload,n,k0,k1);
+      return true;
+    }
+    if (!*this) return false;
+    cols.clear(_nweights);
+    for (uint32_t n = block_size(); n && pos != end; --n)
+      pos = cols.add(pos);
+    c = cols.view();
+    return true;
+  }
+
+  // view of the next event, nothing is copied
+  // valid until the next block is read
+  bool next(hgam_event& e) {
+    if (!*this) return false;
+    pos = decode(pos,e);
+    return true;
+  }
+};
+
+// several .dat shards read as one stream
+// spec is a comma separated list of files or glob patterns,
+// e.g. "shards/data1[5-8]*.dat,extra.dat"
+// shards must all be data or all mc, with the same weights
+class dataset {
+  std::vector<std::string> _files;
+  std::vector<std::unique_ptr<reader>> shards;
+  size_t cur = 0;
+  float _lumi = 0;
+
+public:
+  dataset(const std::string& spec) {
+    for (size_t a=0, b; a<=spec.size(); a=b+1) {
+      b = std::min(spec.find(',',a),spec.size());
+      const std::string pattern = spec.substr(a,b-a);
+      if (pattern.empty()) continue;
+      if (pattern.find_first_of("*?[")==std::string::npos) {
+        _files.push_back(pattern);
+        continue;
+      }
+      glob_t g;
+      if (::glob(pattern.c_str(),0,nullptr,&g)) {
+        globfree(&g);
+        throw ivanp::error("no files match \"",pattern,'\"');
+      }
+      _files.insert(_files.end(),g.gl_pathv,g.gl_pathv+g.gl_pathc);
+      globfree(&g);
+    }
+    if (_files.empty()) throw ivanp::error("empty dataset \"",spec,'\"');
+
+    for (const auto& name : _files) {
+      shards.emplace_back(std::make_unique<reader>(name.c_str()));
+      const reader& r = *shards.back();
+      const reader& r0 = *shards.front();
+      if (r.is_mc() != r0.is_mc() ||
+          r.nweights() != r0.nweights() ||
+          r.format().weights != r0.format().weights)
+        throw ivanp::error("shard \"",name,"\" is not compatible with \"",
+          _files.front(),'\"');
+      _lumi += r.lumi();
+    }
+  }
+
+  const std::vector<std::string>& files() const noexcept { return _files; }
+  size_t size() const noexcept { return shards.size(); }
+  // for handing shards out to workers
+  reader& shard(size_t i) noexcept { return *shards[i]; }
+
+  bool is_mc() const noexcept { return shards.front()->is_mc(); }
+  float lumi() const noexcept { return _lumi; } // sum of data shards
+  uint32_t nevents() const noexcept {
+    uint32_t n = 0;
+    for (const auto& r : shards) n += r->nevents();
+    return n;
+  }
+  unsigned nweights() const noexcept { return shards.front()->nweights(); }
+  const hgam_format& format() const noexcept {
+    return shards.front()->format();
+  }
+
+  operator bool() {
+    for (; cur < shards.size(); ++cur)
+      if (*shards[cur]) return true;
+    return false;
+  }
+
+  void skip_events(uint32_t n) {
+    for (; n && *this; --n) shards[cur]->skip_events(1);
+  }
+
+  bool next(hgam_event& e) {
+    for (; cur < shards.size(); ++cur)
+      if (shards[cur]->next(e)) return true;
+    return false;
+  }
+  bool next(hgam_columns& c) {
+    for (; cur < shards.size(); ++cur)
+      if (shards[cur]->next(c)) return true;
+    return false;
   }
 };
 
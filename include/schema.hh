@@ -0,0 +1,214 @@
+#ifndef SCHEMA_HH
+#define SCHEMA_HH
+
+// self-describing JSON header of event files
+//
+// {"root":[["event#N","events"]],
+//  "types":{"event":[["u4","runNumber"],...],
+//           "4vec":[["f4","pt","eta","phi","m"]]}}
+//
+// types: fN, iN, uN with N bytes, or a type defined in "types"
+// "type#n"       n elements
+// "type#"        number of elements as u4, then the elements
+// "type#f<=k"    number of elements in the preceding field f,
+//                at most k are stored
+//
+// The header is parsed once and matched to a known layout.
+// Each layout has its own decoder, so that event loops templated
+// on the decoder compile to the same memcpy code as a hand written reader.
+
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "ivanp/error.hh"
+
+struct dat_schema {
+  enum layout_t { mxaod_4vec, hgam };
+
+  nlohmann::json json;
+  layout_t layout;
+  std::vector<std::string> weights; // hgam mc
+
+  // parse the header at p and advance p past it
+  dat_schema(const char*& p, const char* end) {
+    if (p==end || *p!='{') throw ivanp::error("no schema header");
+    const char* const begin = p;
+    int nbraces = 0;
+    for (bool str = false; ; ++p) {
+      if (p==end) throw ivanp::error("file ended in header");
+      const char c = *p;
+      if (str) {
+        if (c=='\\') ++p;
+        else if (c=='\"') str = false;
+      } else if (c=='\"') str = true;
+      else if (c=='{') ++nbraces;
+      else if (c=='}' && !--nbraces) break;
+    }
+    json = nlohmann::json::parse(begin,++p);
+
+    const auto& types = json.at("types");
+    if (types.at("4vec") != nlohmann::json::parse(
+          R"([["f4","pt","eta","phi","m"]])"))
+      throw ivanp::error("unknown 4vec type in header");
+    const auto& ev = types.at("event");
+    auto field = [&](size_t i, const char* type, const char* name) {
+      return i < ev.size() && ev[i].size()==2 &&
+        (!type || ev[i][0]==type) && ev[i][1]==name;
+    };
+
+    if (field(0,"u4","runNumber") && field(1,"u8","eventNumber") &&
+        field(2,"4vec#2","photons") && field(3,"4vec#","jets") &&
+        ev.size()==4)
+    {
+      layout = mxaod_4vec;
+      return;
+    }
+    const unsigned w = field(0,nullptr,"weights");
+    if (w) {
+      weights = json.at("weights").get<std::vector<std::string>>();
+      if (ev[0][0]!=cat_type("f4",weights.size()))
+        throw ivanp::error("inconsistent weights in header");
+    }
+    if (field(w,"4vec#2","photons") && field(w+1,"u1","njets") &&
+        field(w+2,"4vec#njets<=4","jets") && ev.size()==w+3)
+    {
+      layout = hgam;
+      return;
+    }
+    throw ivanp::error("unknown event layout in header");
+  }
+
+  static std::string cat_type(const char* type, size_t n) {
+    return std::string(type) + '#' + std::to_string(n);
+  }
+};
+
+// header written by mxaod_4vec
+inline std::string mxaod_4vec_schema_json(uint32_t nevents) {
+  return R"({"root":[["event#)" + std::to_string(nevents) +
+    R"(","events"]],"types":{"event":[)"
+    R"(["u4","runNumber"],["u8","eventNumber"],)"
+    R"(["4vec#2","photons"],["4vec#","jets"]],)"
+    R"("4vec":[["f4","pt","eta","phi","m"]]}})";
+}
+
+// header of hgam .dat records, see reader2.hh
+// weights are the names of mc weights, none for data
+inline std::string hgam_schema_json(const std::vector<std::string>& weights) {
+  std::string s = R"({"root":[["event#","events"]],"types":{"event":[)";
+  if (weights.size())
+    s += "[\"" + dat_schema::cat_type("f4",weights.size()) +
+         "\",\"weights\"],";
+  s += R"(["4vec#2","photons"],["u1","njets"],["4vec#njets<=4","jets"]],)"
+       R"("4vec":[["f4","pt","eta","phi","m"]]})";
+  if (weights.size()) {
+    s += R"(,"weights":)";
+    s += nlohmann::json(weights).dump();
+  }
+  return s += '}';
+}
+
+// decoded event
+// jets points to njets_stored unaligned float[4]
+struct dat_event {
+  uint32_t runNumber = 0;
+  uint64_t eventNumber = 0;
+  const char* weights = nullptr;
+  float y[2][4];
+  uint32_t njets, njets_stored;
+  const char* jets;
+
+  void jet(unsigned i, float(&mom)[4]) const noexcept {
+    memcpy(mom,jets+sizeof(mom)*i,sizeof(mom));
+  }
+  float weight(unsigned i) const noexcept {
+    float w;
+    memcpy(&w,weights+sizeof(w)*i,sizeof(w));
+    return w;
+  }
+};
+
+// view of an hgam record, pointing into the file or the current block
+// momenta are unaligned pt eta phi m floats
+struct hgam_event {
+  const char *weights, *y[2], *jets;
+  uint8_t njets; // all jets
+  unsigned njets_stored;
+
+  static float get(const char* p, unsigned i) noexcept {
+    float x;
+    memcpy(&x,p+sizeof(float)*i,sizeof(float));
+    return x;
+  }
+  float weight(unsigned i) const noexcept { return get(weights,i); }
+  const char* jet(unsigned i) const noexcept {
+    return jets + sizeof(float[4])*i;
+  }
+  // the whole record
+  const char* data() const noexcept { return weights; }
+  size_t size() const noexcept {
+    return jets + sizeof(float[4])*njets_stored - weights;
+  }
+};
+
+template <dat_schema::layout_t> struct dat_decoder;
+
+template <> struct dat_decoder<dat_schema::mxaod_4vec> {
+  static constexpr bool has_event_number = true;
+
+  const char* operator()(const char* p, dat_event& e) const noexcept {
+    memcpy(&e.runNumber,p,4); p += 4;
+    memcpy(&e.eventNumber,p,8); p += 8;
+    memcpy(e.y,p,sizeof(e.y)); p += sizeof(e.y);
+    memcpy(&e.njets,p,4); p += 4;
+    e.njets_stored = e.njets;
+    e.jets = p;
+    return p + sizeof(float[4])*e.njets;
+  }
+};
+
+template <> struct dat_decoder<dat_schema::hgam> {
+  static constexpr bool has_event_number = false;
+  unsigned nweights;
+
+  const char* operator()(const char* p, dat_event& e) const noexcept {
+    e.weights = p; p += sizeof(float)*nweights;
+    memcpy(e.y,p,sizeof(e.y)); p += sizeof(e.y);
+    e.njets = uint8_t(*p++);
+    e.njets_stored = e.njets>4 ? 4 : e.njets;
+    e.jets = p;
+    return p + sizeof(float[4])*e.njets_stored;
+  }
+  // without copying
+  const char* operator()(const char* p, hgam_event& e) const noexcept {
+    e.weights = p; p += sizeof(float)*nweights;
+    e.y[0] = p;
+    e.y[1] = p + sizeof(float[4]);
+    p += sizeof(float[2][4]);
+    e.njets = uint8_t(*p++);
+    e.njets_stored = e.njets>4 ? 4 : e.njets;
+    e.jets = p;
+    return p + sizeof(float[4])*e.njets_stored;
+  }
+  // end of the record at p
+  const char* skip(const char* p) const noexcept {
+    hgam_event e;
+    return (*this)(p,e);
+  }
+};
+
+// call f with the decoder for the layout
+template <typename F>
+decltype(auto) dispatch(const dat_schema& s, F&& f) {
+  switch (s.layout) {
+    case dat_schema::mxaod_4vec:
+      return f(dat_decoder<dat_schema::mxaod_4vec>{});
+    case dat_schema::hgam:
+      return f(dat_decoder<dat_schema::hgam>{unsigned(s.weights.size())});
+  }
+  throw ivanp::error("unknown layout");
+}
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef SKETCH_HH
+#define SKETCH_HH
+
+// mergeable streaming quantile sketch of weighted values (merging t-digest)
+//
+// Values are buffered and periodically sorted and merged into centroids.
+// A centroid may only grow while it spans at most one unit of the
+// scale k(q) = compression/(2 pi) asin(2q-1), so centroids are small in the
+// tails and the number of centroids is bounded by about the compression,
+// plus the number of values that alone exceed that size, which are kept
+// in centroids of their own.
+// Centroids know the range of their values, so that a cut between
+// non-overlapping centroids divides the sums exactly.
+// Quantiles are in sums of |w|, and each centroid also keeps the sums of
+// w and w^2, which give the statistical precision of a range of values.
+// Merging sketches in the same order gives the same result.
+// Non-finite values, e.g. of variables undefined in an event, are ignored.
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+class sketch {
+public:
+  struct centroid {
+    double x, a, w, w2; // mean, sum of |w|, sum of w, sum of w^2
+    double lo, hi; // range of values
+  };
+
+private:
+  std::vector<centroid> c, buf;
+  double compression;
+  double lo = std::numeric_limits<double>::infinity(), hi = -lo;
+
+public:
+  sketch(double compression = 2000): compression(compression) { }
+
+  void add(double x, double w = 1) {
+    if (!std::isfinite(x)) return; // NaN would break the sort
+    if (x < lo) lo = x;
+    if (x > hi) hi = x;
+    buf.push_back({x,std::abs(w),w,w*w,x,x});
+    if (buf.size() >= 4*compression) compress();
+  }
+
+  sketch& operator+=(const sketch& o) {
+    if (o.lo < lo) lo = o.lo;
+    if (o.hi > hi) hi = o.hi;
+    buf.insert(buf.end(),o.c.begin(),o.c.end());
+    buf.insert(buf.end(),o.buf.begin(),o.buf.end());
+    if (buf.size() >= 4*compression) compress();
+    return *this;
+  }
+
+  void compress() {
+    if (buf.empty()) return;
+    buf.insert(buf.end(),c.begin(),c.end());
+    std::sort(buf.begin(),buf.end(),
+      [](const centroid& a, const centroid& b){ return a.x < b.x; });
+    double total = 0;
+    for (const auto& x : buf) total += x.a;
+    const double norm = compression/(2*M_PI);
+    auto k = [&](double q){
+      return norm*std::asin(2*std::min(q/total,1.)-1);
+    };
+    c.clear();
+    centroid cur = buf.front();
+    double q = 0, kq = k(0); // before cur
+    for (size_t i=1; i<buf.size(); ++i) {
+      const centroid& x = buf[i];
+      if ((cur.lo==cur.hi && x.lo==x.hi && cur.lo==x.lo) ||
+          k(q+cur.a+x.a) - kq <= 1) {
+        const double a = cur.a + x.a;
+        if (a > 0) cur.x += (x.x - cur.x)*(x.a/a);
+        cur.a = a;
+        cur.w += x.w;
+        cur.w2 += x.w2;
+        if (x.lo < cur.lo) cur.lo = x.lo;
+        if (x.hi > cur.hi) cur.hi = x.hi;
+      } else {
+        c.push_back(cur);
+        q += cur.a;
+        kq = k(q);
+        cur = x;
+      }
+    }
+    c.push_back(cur);
+    buf.clear();
+  }
+
+  // sorted by x
+  const std::vector<centroid>& centroids() {
+    compress();
+    return c;
+  }
+
+  double min() const noexcept { return lo; }
+  double max() const noexcept { return hi; }
+  bool empty() const noexcept { return c.empty() && buf.empty(); }
+};
+
+#endif
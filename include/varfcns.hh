@@ -13,12 +13,52 @@ struct less_str {
 // ==================================================================
 bool nj(unsigned n) noexcept { return nj() >= n; }
 
+// quantities shared by several variables, computed at most once per event
+// reset_event_cache() must be called after reading each event
+thread_local struct {
+  enum : unsigned { HT = 1, HT_yy = 2, sum = 4, rap_j = 8 };
+  unsigned have = 0; // rap_j<<i for jet i
+  double HT_jets, HT_jets_yy, rap_jets[3];
+  ivanp::vec4<> yy_jets;
+} event_cache;
+
+inline void reset_event_cache() noexcept { event_cache.have = 0; }
+
 double f_HT_jets() noexcept {
-  double HT = 0;
-  for (const auto& jet : jets) HT += jet.pt();
-  return HT;
+  auto& c = event_cache;
+  if (!(c.have & c.HT)) {
+    c.HT_jets = 0;
+    for (const auto& jet : jets) c.HT_jets += jet.pt();
+    c.have |= c.HT;
+  }
+  return c.HT_jets;
+}
+double f_HT_jets_yy() noexcept {
+  auto& c = event_cache;
+  if (!(c.have & c.HT_yy)) {
+    c.HT_jets_yy = f_HT_jets() + yy.pt();
+    c.have |= c.HT_yy;
+  }
+  return c.HT_jets_yy;
+}
+const ivanp::vec4<>& f_yy_jets() noexcept { // diphoton + all jets
+  auto& c = event_cache;
+  if (!(c.have & c.sum)) {
+    c.yy_jets = yy;
+    for (const auto& jet : jets) c.yy_jets += jet;
+    c.have |= c.sum;
+  }
+  return c.yy_jets;
+}
+double f_rap_j(unsigned i) noexcept { // i < 3, jet must exist
+  auto& c = event_cache;
+  const unsigned bit = c.rap_j << i;
+  if (!(c.have & bit)) {
+    c.rap_jets[i] = jets[i].rap();
+    c.have |= bit;
+  }
+  return c.rap_jets[i];
 }
-double f_HT_jets_yy() noexcept { return f_HT_jets() + yy.pt(); }
 // ==================================================================
 
 struct fcn_t {
@@ -44,11 +84,11 @@ const std::map<const char*,fcn_t,less_str> fcns {
   { "eta_j1", { []{ return nj(1) ? jets[0].eta() : NAN; }, true } },
   { "eta_j2", { []{ return nj(2) ? jets[1].eta() : NAN; }, true } },
   { "eta_j3", { []{ return nj(3) ? jets[2].eta() : NAN; }, true } },
-  { "y_j1", { []{ return nj(1) ? jets[0].rap() : NAN; }, true } },
-  { "y_j2", { []{ return nj(2) ? jets[1].rap() : NAN; }, true } },
-  { "y_j3", { []{ return nj(3) ? jets[2].rap() : NAN; }, true } },
+  { "y_j1", { []{ return nj(1) ? f_rap_j(0) : NAN; }, true } },
+  { "y_j2", { []{ return nj(2) ? f_rap_j(1) : NAN; }, true } },
+  { "y_j3", { []{ return nj(3) ? f_rap_j(2) : NAN; }, true } },
   { "dy_j1_j2", {
-    []{ return nj(2) ? std::abs(jets[0].rap()-jets[1].rap()) : NAN; }, true } },
+    []{ return nj(2) ? std::abs(f_rap_j(0)-f_rap_j(1)) : NAN; }, true } },
   { "m_jj", { []{ return nj(2) ? (jets[0]+jets[1]).m() : NAN; }, true } },
 
   { "Hj_mass", { []{ return nj(1) ? (yy+jets[0]).m() : NAN; }, true } },
@@ -61,16 +101,8 @@ const std::map<const char*,fcn_t,less_str> fcns {
   { "x_j2", { []{ return nj(2) ? jets[1].pt()/f_HT_jets_yy() : 0; }, true } },
   { "x_j3", { []{ return nj(3) ? jets[2].pt()/f_HT_jets_yy() : 0; }, true } },
 
-  { "pT_miss", { []{
-      auto p = yy;
-      for (const auto& jet : jets) p += jet;
-      return p.pt();
-    }, true } },
-  { "s2", { []{
-      auto p = yy;
-      for (const auto& jet : jets) p += jet;
-      return p.m();
-    }, true } },
+  { "pT_miss", { []{ return f_yy_jets().pt(); }, true } },
+  { "s2", { []{ return f_yy_jets().m(); }, true } },
 };
 
 #endif
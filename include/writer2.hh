@@ -0,0 +1,156 @@
+#ifndef WRITER2_HH
+#define WRITER2_HH
+
+// writes hgam .dat v3 files, see reader2.hh
+// output is written sequentially, event counts are in the footer,
+// so it can go to a pipe
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "reader2.hh"
+
+class writer {
+  std::ostream& out;
+  std::string block;
+  std::vector<uint64_t> index;
+  uint64_t pos = 0;
+  uint32_t block_nevents = 0, _nevents = 0;
+  const hgam_format format;
+  const unsigned nweights;
+  bool closed = false;
+  hgam_column_buffer cols;
+  std::string buf, zbuf, tmp;
+
+  template <typename T>
+  void put(const T& x) {
+    out.write(reinterpret_cast<const char*>(&x),sizeof(x));
+    pos += sizeof(x);
+  }
+
+  template <typename T>
+  static void append(std::string& s, const std::vector<T>& c) {
+    s.append(reinterpret_cast<const char*>(c.data()),sizeof(T)*c.size());
+  }
+
+  void write_block() {
+    if (!block_nevents) return;
+    const std::string* payload = &block;
+    if (format.columnar) {
+      cols.clear(nweights);
+      for (const char *rec = block.data(), *end = rec + block.size();
+           rec < end; ) rec = cols.add(rec);
+      const uint32_t njets_stored = cols.jets[0].size();
+      buf.clear();
+      buf.append(reinterpret_cast<const char*>(&njets_stored),4);
+      for (const auto& c : cols.weight) append(buf,c);
+      for (const auto& y : cols.y) for (const auto& c : y) append(buf,c);
+      for (const auto& c : cols.jets) append(buf,c);
+      append(buf,cols.njets);
+      buf.resize(
+        columnar_payload_size(block_nevents,njets_stored,nweights));
+      payload = &buf;
+    }
+    const uint32_t raw_nbytes = payload->size();
+    if (format.compressed && block_compress(*payload,zbuf,tmp))
+      payload = &zbuf;
+
+    index.push_back(pos);
+    put(block_nevents);
+    put(uint32_t(payload->size()));
+    if (format.compressed) put(raw_nbytes);
+    out.write(payload->data(),payload->size());
+    pos += payload->size();
+    block.clear();
+    block_nevents = 0;
+  }
+
+  // compressed blocks are always columnar: in rows, the njets byte
+  // shifts the floats of the following records off the 4-byte grid,
+  // and the shuffle would mix exponent and mantissa bytes
+  static hgam_format block_format(hgam_format f) noexcept {
+    if (f.compressed) f.columnar = true;
+    return f;
+  }
+
+public:
+  writer(std::ostream& out, bool is_mc, float lumi,
+         const hgam_format& fmt = { })
+  : out(out), format(block_format(fmt)), nweights(fmt.nweights(is_mc))
+  {
+    if (format.weights.size() > 255)
+      throw ivanp::error("too many weights");
+    out.write(hgam_v3_magic,4);
+    pos += 4;
+    put(is_mc ? 'm' : 'd');
+    put(uint8_t( // flags
+      (format.columnar ? hgam_columnar : 0) |
+      (format.compressed ? hgam_compressed : 0) |
+      (is_mc && format.weights.size() ? hgam_weights : 0) |
+      hgam_schema | hgam_end_marker ));
+    put(lumi);
+    put(format.block_size);
+    if (is_mc && format.weights.size()) {
+      put(uint8_t(format.weights.size()));
+      for (const auto& name : format.weights) {
+        if (name.size() > 255) throw ivanp::error(
+          "weight name \"",name,"\" is longer than 255 bytes");
+        put(uint8_t(name.size()));
+        out.write(name.data(),name.size());
+        pos += name.size();
+      }
+    }
+    { const std::string schema = hgam_schema_json(
+        !is_mc ? std::vector<std::string>{} :
+        format.weights.size() ? format.weights :
+        std::vector<std::string>{"weight"} );
+      put(uint32_t(schema.size()));
+      out.write(schema.data(),schema.size());
+      pos += schema.size();
+    }
+    if (format.columnar) // align columns
+      while (pos % 4) put('\0');
+  }
+  ~writer() { if (!closed) close(); }
+
+  // append to the current event
+  template <typename T>
+  writer& operator()(const T& x) {
+    block.append(reinterpret_cast<const char*>(&x),sizeof(x));
+    return *this;
+  }
+  writer& write(const char* p, size_t n) {
+    block.append(p,n);
+    return *this;
+  }
+
+  void end_event() {
+    ++_nevents;
+    if (++block_nevents == format.block_size) write_block();
+  }
+  // append a complete record
+  void event(const char* rec, size_t n) {
+    write(rec,n);
+    end_event();
+  }
+
+  uint32_t nevents() const noexcept { return _nevents; }
+
+  void close() {
+    write_block();
+    put(uint32_t(0)); // end of blocks marker
+    put(uint32_t(0));
+    if (format.compressed) put(uint32_t(0));
+    const uint64_t index_pos = pos;
+    for (auto x : index) put(x);
+    put(index_pos);
+    put(uint32_t(index.size()));
+    put(_nevents);
+    out.write(hgam_v3_magic,4);
+    out.flush();
+    closed = true;
+  }
+};
+
+#endif
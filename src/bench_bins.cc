@@ -0,0 +1,82 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <limits>
+
+#include "axis.hh"
+
+using std::cout;
+using std::endl;
+using std::cerr;
+
+// compares std::upper_bound to axis::find
+// for bin edges of the sizes used in bins files
+int main(int argc, char* argv[]) {
+  const size_t n = argc>1 ? atoi(argv[1]) : 1 << 24;
+  const double inf = std::numeric_limits<double>::infinity();
+
+  std::mt19937_64 gen(12345);
+  std::vector<double> x(n);
+  { std::exponential_distribution<double> d(1./60);
+    for (auto& v : x) v = d(gen); // like a pT spectrum
+  }
+
+  auto uniform = [](unsigned nb, double a, double b){
+    std::vector<double> e;
+    const double d = (b-a)/nb;
+    e.push_back(a);
+    for (unsigned i=1; i<nb; ++i) e.push_back(a+d*i);
+    e.push_back(b);
+    return e;
+  };
+  auto with_inf = [&](std::vector<double> e){
+    e.push_back(inf);
+    return e;
+  };
+  auto irregular = [&](unsigned nb, double b){
+    std::vector<double> e;
+    for (unsigned i=0; i<=nb; ++i) e.push_back(b*std::pow(double(i)/nb,1.5));
+    return e;
+  };
+
+  const std::pair<const char*,std::vector<double>> cases[] {
+    { "uniform 10", uniform(10,0,200) },
+    { "uniform 100 +inf", with_inf(uniform(100,0,300)) },
+    { "uniform 1000", uniform(1000,0,500) },
+    { "irregular 6 +inf", { 0, 20, 40, 60, 100, 200, inf } },
+    { "irregular 30", irregular(30,300) },
+    { "irregular 300", irregular(300,500) },
+  };
+
+  using clock = std::chrono::steady_clock;
+  auto time = [&](auto&& f){
+    const auto t0 = clock::now();
+    size_t sum = 0;
+    for (double v : x) sum += f(v);
+    const double ns = std::chrono::duration<double,std::nano>(
+      clock::now()-t0).count()/n;
+    return std::make_pair(ns,sum);
+  };
+
+  cout << "values: " << n << '\n';
+  for (const auto& [name, edges] : cases) {
+    const axis ax(edges);
+    const auto [t1, s1] = time([&](double v){
+      return size_t(std::upper_bound(edges.begin(),edges.end(),v)
+                    - edges.begin());
+    });
+    const auto [t2, s2] = time([&](double v){ return ax.find(v); });
+    for (double v : x)
+      if (ax.find(v) != size_t(
+            std::upper_bound(edges.begin(),edges.end(),v) - edges.begin()))
+      {
+        cerr << "\033[31m" << name << ": mismatch at " << v << "\033[0m\n";
+        return 1;
+      }
+    cout << name << (ax.is_uniform() ? " (arithmetic)" : " (branchless)")
+         << ": upper_bound " << t1 << " ns, axis " << t2 << " ns, x"
+         << t1/t2 << (s1==s2 ? "" : " (sums differ)") << endl;
+  }
+}
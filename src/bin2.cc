@@ -5,11 +5,25 @@
 #include <limits>
 #include <algorithm>
 #include <cmath>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <exception>
+#include <memory>
+#include <cstring>
+#include <cstdlib>
+#include <sys/stat.h>
 
 #include "ivanp/io/mem_file.hh"
-#include "ivanp/math/vec4.hh"
-#include "ivanp/timed_counter.hh"
+#include "ivanp/error.hh"
 #include "reader2.hh"
+#include "batch.hh"
+#include "hist.hh"
+#include "axis.hh"
+#include "expr.hh"
+#include "hist_io.hh"
+#include "bootstrap.hh"
+#include "sketch.hh"
 
 #define TEST(var) \
   std::cout << "\033[36m" #var "\033[0m = " << var << std::endl;
@@ -18,205 +32,572 @@ using std::cout;
 using std::endl;
 using std::cerr;
 
-using vec4 = ivanp::vec4<double>;
-
 const double inf = std::numeric_limits<double>::infinity();
 
-float lumi=0, weight=1;
-uint32_t nevents_total = 0;
-bool is_mc, need_jets=false;
-uint8_t njets=0, njets_stored=0;
+// events per unit of work
+// threads take contiguous ranges of units, and their results are added
+// in thread order, so the output is the same for the same number of threads
+constexpr uint32_t unit_size = 1 << 18;
 
-// ==================================================================
-vec4 y[2], jets[4], yy;
+float lumi=0;
+uint32_t nevents_total = 0;
 
-auto nj() noexcept { return njets; }
+struct vardef {
+  unsigned x; // column in the expression program
+  std::vector<double> edges;
+  axis ax;
+  std::string name;
+};
 
-#include "varfcns.hh"
-// ==================================================================
+// one bins definition, one output file
+struct config {
+  std::string name;
+  std::vector<vardef> vars;
+  size_t nbins = 1;
+};
 
-struct bin_t {
-  double w = 0, w2 = 0;
-  void operator++() noexcept {
-    ++w; ++w2;
+// bins files consist of lines
+//   var: edges
+// where edges are numbers, inf, or (n min max) for n uniform bins
+// lines [name] start a new named binning in the same file
+void read_bins(const std::string& fname, std::vector<config>& configs) {
+  std::ifstream f(fname);
+  if (!f) throw ivanp::error("cannot open \"",fname,'\"');
+  { const size_t a = fname.rfind('/')+1;
+    configs.push_back({ fname.substr(a,fname.rfind('.')-a) });
   }
-  void operator+=(double weight) noexcept {
-    w  += weight;
-    w2 += weight*weight;
+  bool named = false;
+  size_t g = 0;
+  for (std::string line; getline(f,line); ) {
+    if (line.empty()||line[0]=='#') continue;
+    if (line[0]=='[') {
+      const size_t end = line.find(']');
+      if (end==std::string::npos)
+        throw ivanp::error("invalid binning name: ",line);
+      if (named || configs.back().vars.size())
+        configs.emplace_back();
+      configs.back().name = line.substr(1,end-1);
+      named = true;
+      continue;
+    }
+    const size_t col = line.find(':');
+    if (col==std::string::npos) continue;
+    auto& vars = configs.back().vars;
+    vars.emplace_back();
+    auto& var = vars.back();
+    var.name = line.substr(0,col);
+    size_t a = col + 1, b = a;
+    for (;;) {
+      char c = line[b];
+      if (std::isspace(c)||c==','||c=='('||c==')'||c=='\0') {
+        if (b > a) {
+          auto x = line.substr(a,b+1-a);
+          if (x=="inf" || x=="infty" || x=="∞")
+            var.edges.push_back(inf);
+          else if (x=="-inf" || x=="-infty" || x=="-∞")
+            var.edges.push_back(-inf);
+          else
+            var.edges.push_back(stod(x));
+        }
+        if (!c) break;
+        else if (c=='(') g = var.edges.size(); // (n min max)
+        else if (c==')') {
+          if (var.edges.size()-g!=3)
+            throw ivanp::error("invalid edges definition: ",line);
+          unsigned n = var.edges[g];
+          const double a = var.edges[g+1], b = var.edges[g+2], d = (b-a)/n;
+          var.edges.resize(g);
+          var.edges.push_back(a);
+          for (unsigned i=1; i<n; ++i)
+            var.edges.push_back(a+d*i);
+          var.edges.push_back(b);
+          g = 0;
+        }
+        a = ++b;
+      } else ++b;
+    }
   }
-  bin_t& operator+=(const bin_t& b) noexcept {
-    w  += b.w;
-    w2 += b.w2;
-    return *this;
+  if (configs.back().vars.empty()) configs.pop_back();
+}
+
+// edges for bins of relative statistical precision p, sqrt(sum w^2)/sum w,
+// in each sample that has events in [lo,hi)
+// edges are placed between centroids of the sketches, in the gap between
+// their values if they do not overlap, e.g. for discrete variables,
+// otherwise between their means, so the precision is approximate;
+// a last bin short of the precision is merged into the previous one
+std::vector<double> auto_edges(
+  sketch& data, sketch& mc, double p, double lo, double hi
+) {
+  struct point { double x, lo, hi, w[2], w2[2]; };
+  std::vector<point> ps;
+  double total[2] { };
+  for (int s=0; s<2; ++s)
+    for (const auto& c : (s ? mc : data).centroids()) {
+      point x { c.x, c.lo, c.hi };
+      x.w[s] = c.w;
+      x.w2[s] = c.w2;
+      total[s] += c.w;
+      ps.push_back(x);
+    }
+  std::stable_sort(ps.begin(),ps.end(),
+    [](const point& a, const point& b){ return a.x < b.x; });
+
+  std::vector<double> edges { lo };
+  double w[2] { }, w2[2] { }, end = -inf; // end of values so far
+  auto precise = [&]{
+    for (int s=0; s<2; ++s)
+      if (total[s]!=0 && !(w[s] > 0 && std::sqrt(w2[s]) <= p*w[s]))
+        return false;
+    return true;
+  };
+  for (size_t i=0; i<ps.size(); ++i) {
+    for (int s=0; s<2; ++s) {
+      w[s] += ps[i].w[s];
+      w2[s] += ps[i].w2[s];
+    }
+    end = std::max(end,ps[i].hi);
+    if (i+1 < ps.size() && ps[i].x < ps[i+1].x && precise()) {
+      edges.push_back(end < ps[i+1].lo
+        ? (end + ps[i+1].lo)/2 : (ps[i].x + ps[i+1].x)/2);
+      std::fill(w,w+2,0);
+      std::fill(w2,w2+2,0);
+    }
   }
-};
+  if (edges.size() > 1 && !precise()) edges.pop_back();
+  edges.push_back(hi);
+  return edges;
+}
 
-template <typename E>
-size_t find_bin(double x, const E& edges) {
-  return std::distance(
-    edges.begin(), std::upper_bound(edges.begin(), edges.end(), x)
-  );
+// identifies a shard, so that it is not binned twice,
+// by its path and by its content: the size, the number of events,
+// and a hash of the header and block index
+hist_input input_of(dataset& read, size_t s) {
+  const std::string& fname = read.files()[s];
+  const reader& r = read.shard(s);
+  hist_input in { "-", r.is_mc(), 0, r.nevents(), r.is_mc() ? 0 : r.lumi() };
+  if (fname!="-") {
+    struct stat sb;
+    if (!stat(fname.c_str(),&sb) && S_ISREG(sb.st_mode)) {
+      char* path = realpath(fname.c_str(),nullptr);
+      if (path) {
+        in.name = path;
+        free(path);
+      }
+      in.size = sb.st_size;
+      in.hash = splitmix64(
+        fnv1a(r.header_bytes()) ^ splitmix64(fnv1a(r.tail_bytes())));
+    }
+  }
+  return in;
 }
 
 int main(int argc, char* argv[]) {
-  if (argc!=5) {
-    cout << "usage: " << argv[0] << " data.dat mc.dat bins.txt out.json\n";
+  const char* state_pattern = nullptr; // start from a saved state
+  unsigned nboot = 0; // bootstrap replicas
+  double auto_prec = 0; // choose edges instead of binning
+  for (; argc > 2 && argv[1][0]=='-' && argv[1][1] && !argv[1][2];
+       argv += 2, argc -= 2)
+  {
+    if (argv[1][1]=='s') state_pattern = argv[2]; else
+    if (argv[1][1]=='b') nboot = atoi(argv[2]); else
+    if (argv[1][1]=='a') auto_prec = atof(argv[2]); else
+    break;
+  }
+  if (argc!=5 && argc!=6) {
+    cout << "usage: " << argv[0]
+         << " [-s state.bin] [-b nboot] [-a precision]"
+            " data.dat mc.dat bins.txt out.json [nthreads]\n"
+            "  .dat arguments can be comma separated lists or globs,\n"
+            "  or - for stdin\n"
+            "  bins.txt can be a comma separated list of files,\n"
+            "  and files can have several [name] sections;\n"
+            "  with more than one binning, % in out.json is replaced\n"
+            "  by the binning name\n"
+            "  output ending in .bin is binary, see hist_io.hh,\n"
+            "  and can be used as -s state of a later run,\n"
+            "  which bins only the shards that are not in the state\n"
+            "  -b fills nboot Poisson bootstrap replicas of data and\n"
+            "  nominal mc, seeded by file name, event position\n"
+            "  and the photon momenta\n"
+            "  -a writes to out.txt, in bins.txt syntax, edges for which\n"
+            "  every bin has the given relative statistical precision\n"
+            "  in data and in mc, e.g. -a 0.05, from one pass;\n"
+            "  variables in bins.txt need no edges, given edges set\n"
+            "  the range\n";
     return 1;
   }
 
-  struct vardef {
-    double(*f)();
-    std::vector<double> edges;
-    std::string name;
-  };
-  std::vector<vardef> vars;
-  { std::ifstream f(argv[3]);
-    size_t g = 0;
-    for (std::string line; getline(f,line); ) {
-      if (line.empty()||line[0]=='#') continue;
-      const size_t col = line.find(':');
-      if (col==std::string::npos) continue;
-      vars.emplace_back();
-      auto& var = vars.back();
-      var.name = line.substr(0,col);
-      size_t a = col + 1, b = a;
-      for (;;) {
-        char c = line[b];
-        if (std::isspace(c)||c==','||c=='('||c==')'||c=='\0') {
-          if (b > a) {
-            auto x = line.substr(a,b+1-a);
-            if (x=="inf" || x=="infty" || x=="∞")
-              var.edges.push_back(inf);
-            else if (x=="-inf" || x=="-infty" || x=="-∞")
-              var.edges.push_back(-inf);
-            else
-              var.edges.push_back(stod(x));
-          }
-          if (!c) break;
-          else if (c=='(') g = var.edges.size(); // (n min max)
-          else if (c==')') {
-            if (var.edges.size()-g!=3) {
-              cerr << "\033[31minvalid edges definition\033[0m\n";
-              cerr << line << endl;
-              return 1;
-            }
-            unsigned n = var.edges[g];
-            const double a = var.edges[g+1], b = var.edges[g+2], d = (b-a)/n;
-            var.edges.resize(g);
-            var.edges.push_back(a);
-            for (unsigned i=1; i<n; ++i)
-              var.edges.push_back(a+d*i);
-            var.edges.push_back(b);
-            g = 0;
-          }
-          a = ++b;
-        } else ++b;
+  std::vector<config> configs;
+  for (const char *a = argv[3], *b; ; a = b+1) {
+    b = strchr(a,',');
+    if (!b) b = a + strlen(a);
+    if (b > a) read_bins({a,b},configs);
+    if (!*b) break;
+  }
+  if (configs.empty()) {
+    cerr << "\033[31mno binnings defined\033[0m\n";
+    return 1;
+  }
+  // names select the output files, e.g. a/bins.txt and b/bins.txt collide
+  for (size_t c=1; c<configs.size(); ++c)
+    for (size_t d=0; d<c; ++d)
+      if (configs[c].name==configs[d].name) {
+        cerr << "\033[31mbinning name \"" << configs[c].name
+             << "\" is defined more than once\033[0m\n";
+        return 1;
       }
+  const std::string out_pattern = argv[4];
+  const size_t out_pct = out_pattern.find('%');
+  if (auto_prec) {
+    if (state_pattern || nboot) {
+      cerr << "\033[31m-a cannot be used with -s or -b\033[0m\n";
+      return 1;
     }
+  } else if (configs.size() > 1 && out_pct==std::string::npos) {
+    cerr << "\033[31mmultiple binnings need % in the output name\033[0m\n";
+    return 1;
   }
+  auto config_file = [&](const std::string& pattern, size_t c) {
+    const size_t pct = pattern.find('%');
+    return pct==std::string::npos ? pattern :
+      std::string(pattern).replace(pct,1,configs[c].name);
+  };
 
-  size_t nbins = 1;
-  for (auto& var : vars) {
-    cout << var.name << ":";
-    for (const auto& x : var.edges)
-      cout << " " << x;
-    cout << endl;
-    try {
-      const auto& fcn = fcns.at(var.name.c_str());
-      var.f = fcn.f;
-      need_jets |= fcn.need_jets;
-    } catch (...) {
-      cerr << "\033[31mvariable \""<< var.name <<"\" is not defined\033[0m\n";
+  std::vector<std::unique_ptr<hist_file>> states;
+  std::vector<hist_input> old_inputs; // binned in the state
+  if (state_pattern) {
+    if (configs.size() > 1 && !strchr(state_pattern,'%')) {
+      cerr << "\033[31mmultiple binnings need % in the state name\033[0m\n";
       return 1;
     }
-    nbins *= (var.edges.size()-1);
+    for (size_t c=0; c<configs.size(); ++c) {
+      const std::string fname = config_file(state_pattern,c);
+      states.push_back(std::make_unique<hist_file>(fname));
+      const auto& in = states.back()->inputs;
+      if (c==0) old_inputs = in;
+      else if (!std::equal(in.begin(),in.end(),
+          old_inputs.begin(),old_inputs.end(),
+          [](const hist_input& a, const hist_input& b){
+            return a.name==b.name && a.size==b.size &&
+                   a.nevents==b.nevents && a.hash==b.hash;
+          }) || states.back()->lumi!=states[0]->lumi)
+      {
+        cerr << "\033[31m\"" << fname
+             << "\" has different inputs than the other states\033[0m\n";
+        return 1;
+      }
+    }
+    lumi = states[0]->lumi;
+    TEST(old_inputs.size())
   }
-  TEST(nbins)
-  std::vector<bin_t> data(nbins), mc(nbins);
+  std::vector<hist_input> new_inputs;
 
-  for (const char* fname : {argv[1],argv[2]}) {
-    reader read(fname);
-
-    char dm;
-    switch (read(dm)) {
-      case 'm': is_mc = true; break;
-      case 'd': is_mc = false; break;
-      default: {
-        cerr << "\033[31mfile \"" << fname << "\" starts with \'" << dm
-          << "\' instead of \'d\' or \'m\'\033[0m\n";
+  // variables of all binnings, evaluated over batches of events
+  // names in bins files can be expressions of variables, see expr.hh
+  expr_program prog;
+  for (auto& c : configs) {
+    if (configs.size() > 1) cout << '[' << c.name << "]\n";
+    for (auto& var : c.vars) {
+      cout << var.name << ":";
+      for (const auto& x : var.edges)
+        cout << " " << x;
+      cout << endl;
+      try {
+        var.x = prog.add(var.name);
+      } catch (const std::exception& e) {
+        cerr << "\033[31m" << e.what() << "\033[0m\n";
         return 1;
       }
+      if (auto_prec) continue; // edges are only the range
+      var.ax = var.edges;
+      c.nbins *= (var.edges.size()-1);
     }
-    if (!is_mc) {
-      read(lumi);
-      TEST(lumi);
-      weight = 1;
-    }
-    read(nevents_total);
-    TEST(nevents_total);
+    TEST(c.nbins)
+  }
+  unsigned nthreads = argc>5 ? atoi(argv[5])
+                             : std::thread::hardware_concurrency();
+  if (nthreads < 1) nthreads = 1;
+  TEST(nthreads)
+  if (nboot) TEST(nboot)
+
+  // histograms of all configs, filled in the same pass
+  using hists_t = std::vector<hist>;
+  auto make_hists = [&](size_t nweights) {
+    hists_t h;
+    h.reserve(configs.size());
+    for (const auto& c : configs) h.emplace_back(c.nbins,nweights);
+    return h;
+  };
+
+  // automatic binning, a sketch of every variable, [config][var]
+  // histograms are not filled
+  using sketches_t = std::vector<std::vector<sketch>>;
+  auto make_sketches = [&]{
+    sketches_t sk;
+    if (auto_prec)
+      for (const auto& c : configs) sk.emplace_back(c.vars.size());
+    return sk;
+  };
+  auto in_range = [](const vardef& var, double x) {
+    return var.edges.size() < 2 ||
+      (var.edges.front() <= x && x < var.edges.back());
+  };
+
+  // bootstrap replicas are weights nw ... nw+nboot-1 of the histograms
+  // they are seeded by the shard, the event's position in it,
+  // and the photon momenta, see bootstrap.hh
+  auto add_replicas = [&](bin_t* x, double w, const float* k) {
+    for (unsigned r=0; r<nboot; ++r) x[r] += k[r]*w;
+  };
 
-    auto& bins = is_mc ? mc : data;
-    { ivanp::timed_counter<> ent;
-      for (; read; ++ent) {
-        if (is_mc) read(weight);
-        read(y[0]);
-        read(y[1]);
-        yy = y[0] + y[1];
-        read(njets);
-        njets_stored = njets>4 ? 4 : njets;
-        if (need_jets) {
-          for (decltype(njets) i=0; i<njets_stored; ++i)
-            read(jets[i]);
+  // returns number of events read
+  auto fill = [&](reader& read, hists_t& hs, sketches_t& sk,
+      bool is_mc, uint64_t shard_seed, uint64_t first_event) {
+    const auto b = std::make_unique<event_batch>();
+    expr_program eval = prog; // columns are per thread
+    std::vector<long> bin(batch_size);
+    std::vector<float> kb(size_t(batch_size)*nboot);
+    const size_t nw = hs[0].nweights() - nboot;
+    if (is_mc) b->set_nweights(nw);
+    uint64_t n = 0;
+    auto flush = [&]{
+      b->decode();
+      eval(*b);
+      for (size_t c=0; c<sk.size(); ++c) {
+        const auto& vars = configs[c].vars;
+        for (size_t v=0; v<vars.size(); ++v) {
+          const double* x = eval[vars[v].x];
+          for (unsigned i=0; i<b->n; ++i)
+            if (in_range(vars[v],x[i]))
+              sk[c][v].add(x[i], is_mc ? b->weight(0,i) : 1);
+        }
+      }
+      if (nboot) {
+        const uint64_t first = first_event + n - b->n;
+        for (unsigned i=0; i<b->n; ++i) {
+          uint64_t h = 0;
+          for (const auto& p : b->y)
+            for (const double* x : { p.pt, p.eta, p.phi, p.m })
+              h = mix(h,x[i]);
+          poisson1(event_seed(shard_seed,first+i,h),nboot,&kb[i*nboot]);
+        }
+      }
+      for (size_t c=0; c<configs.size() && !auto_prec; ++c) {
+        find_bins(b->n,configs[c].vars,
+          [&](const vardef& var){ return eval[var.x]; }, bin.data());
+        hist& h = hs[c];
+        if (is_mc) {
+          for (unsigned i=0; i<b->n; ++i) {
+            if (bin[i] < 0) continue;
+            bin_t* x = h[bin[i]];
+            for (size_t k=0; k<nw; ++k) x[k] += b->weight(k,i);
+            if (nboot) add_replicas(x+nw,b->weight(0,i),&kb[i*nboot]);
+          }
         } else {
-          read.skip(sizeof(float[4])*njets_stored);
+          for (unsigned i=0; i<b->n; ++i) {
+            if (bin[i] < 0) continue;
+            bin_t* x = h[bin[i]];
+            *x += 1;
+            if (nboot) add_replicas(x+1,1,&kb[i*nboot]);
+          }
+        }
+      }
+      b->clear();
+    };
+    if (read.format().columnar) { // no transposition into rows
+      for (hgam_columns cols; read.next(cols); ) {
+        uint32_t jet = 0;
+        for (uint32_t i=0; i<cols.n; ) {
+          const unsigned m = std::min<uint32_t>(batch_size-b->n, cols.n-i);
+          b->add_columns(cols,i,m,jet);
+          i += m;
+          n += m;
+          if (b->full()) flush();
         }
-        // ----------------------------------------------------------
-        size_t bin = 0;
-        for (size_t i=0; i<vars.size(); ++i) {
-          size_t b = find_bin(vars[i].f(),vars[i].edges);
-          if (b==0 || b==vars[i].edges.size()) goto next_event;
-          --b;
-          if (b==0) continue;
-          for (size_t j=0; j<i; ++j) b *= (vars[j].edges.size()-1);
-          bin += b;
+      }
+    } else {
+      for (hgam_event ev; read.next(ev); ) {
+        b->add(ev.y[0],ev.y[1],ev.njets,ev.njets_stored,ev.jets,ev.weights);
+        ++n;
+        if (b->full()) flush();
+      }
+    }
+    if (b->n) flush();
+    return n;
+  };
+  hists_t data, mc;
+  sketches_t data_sk, mc_sk;
+  std::vector<std::string> weight_names;
+
+  for (const char* fname : {argv[1],argv[2]}) {
+    dataset read(fname);
+
+    const bool is_mc = read.is_mc();
+    if (is_mc) {
+      weight_names = read.format().weights;
+      TEST(read.nweights())
+    }
+    nevents_total = read.nevents();
+    TEST(nevents_total);
+
+    std::vector<char> skip(read.size());
+    for (size_t s=0; s<read.size(); ++s) {
+      const hist_input in = input_of(read,s);
+      for (const auto& old : old_inputs) {
+        if (in.same_content(old)) {
+          skip[s] = true;
+          if (in.name!=old.name)
+            cerr << "\033[33m" << read.files()[s] << " is in the state as "
+                 << old.name << "\033[0m\n";
+        } else if (in.name==old.name && in.name!="-") {
+          cerr << "\033[31m" << read.files()[s]
+               << " has changed since it was binned in the state\033[0m\n";
+          return 1;
         }
-        bins[bin] += weight;
-        // ----------------------------------------------------------
-next_event: ;
       }
-      if (ent!=nevents_total) {
-        cerr << "\033[31m" << nevents_total << " expected, "
-          << ent << " events read\033[0m" << endl;
+      if (skip[s]) cout << read.files()[s] << " is in the state" << endl;
+    }
+
+    // split shards into units of whole blocks
+    // shards without an index, e.g. streams, are one unit
+    struct unit { size_t shard; uint32_t begin, end; bool whole; };
+    std::vector<unit> units;
+    for (size_t s=0; s<read.size(); ++s) {
+      if (skip[s]) continue;
+      const reader& r = read.shard(s);
+      if (!r.indexed()) {
+        units.push_back({s,0,0,true});
+        continue;
+      }
+      const uint32_t bs = r.version()==3 ? r.block_size() : 1;
+      const uint64_t step = uint64_t((unit_size + bs-1)/bs)*bs;
+      for (uint64_t b=0; b < r.nevents(); b += step)
+        units.push_back({s, uint32_t(b),
+          uint32_t(std::min<uint64_t>(b+step,r.nevents())), false});
+    }
+
+    hists_t& total = is_mc ? mc : data;
+    const size_t nweights = (is_mc ? read.nweights() : 1) + nboot;
+    sketches_t& total_sk = is_mc ? mc_sk : data_sk;
+
+    // every thread fills one set of histograms from a contiguous range
+    // of units, and the sets are added in thread order
+    const unsigned nt = std::max<size_t>(
+      std::min<size_t>(nthreads,units.size()), 1);
+    std::vector<hists_t> partial(nt);
+    std::vector<sketches_t> partial_sk(nt);
+    std::vector<uint64_t> partial_n(nt);
+    std::atomic<bool> failed { false };
+    std::mutex mx;
+    std::exception_ptr err;
+
+    auto worker = [&](unsigned t){
+      try {
+        hists_t& h = partial[t] = make_hists(nweights);
+        sketches_t& sk = partial_sk[t] = make_sketches();
+        for (size_t u = units.size()*t/nt, u1 = units.size()*(t+1)/nt;
+             u < u1 && !failed; ++u) {
+          const auto& [s, begin, end, whole] = units[u];
+          const std::string& fname = read.files()[s];
+          const uint64_t seed =
+            fnv1a(std::string_view(fname).substr(fname.rfind('/')+1));
+          if (whole)
+            partial_n[t] += fill(read.shard(s),h,sk,is_mc,seed,0);
+          else {
+            reader r(fname.c_str(),begin,end);
+            partial_n[t] += fill(r,h,sk,is_mc,seed,begin);
+          }
+        }
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(mx);
+        if (!err) err = std::current_exception();
+        failed = true;
       }
+    };
+    { std::vector<std::thread> threads;
+      for (unsigned t=1; t<nt; ++t) threads.emplace_back(worker,t);
+      worker(0);
+      for (auto& t : threads) t.join();
+    }
+    if (err) std::rethrow_exception(err);
+
+    total = std::move(partial[0]);
+    total_sk = std::move(partial_sk[0]);
+    uint64_t nread = partial_n[0];
+    for (unsigned t=1; t<nt; ++t) {
+      for (size_t c=0; c<total.size(); ++c) total[c] += partial[t][c];
+      hists_t().swap(partial[t]);
+      for (size_t c=0; c<total_sk.size(); ++c)
+        for (size_t v=0; v<total_sk[c].size(); ++v)
+          total_sk[c][v] += partial_sk[t][c][v];
+      sketches_t().swap(partial_sk[t]);
+      nread += partial_n[t];
+    }
+
+    // event counts of streams are known at the end
+    nevents_total = 0;
+    for (size_t s=0; s<read.size(); ++s) {
+      if (skip[s]) continue;
+      new_inputs.push_back(input_of(read,s));
+      nevents_total += new_inputs.back().nevents;
+      lumi += new_inputs.back().lumi;
+    }
+    if (!is_mc) TEST(lumi)
+    if (nread!=nevents_total) {
+      cerr << "\033[31m" << nevents_total << " expected, "
+        << nread << " events read\033[0m" << endl;
     }
   }
 
   // write output ---------------------------------------------------
-  std::ofstream out(argv[4]);
-  out << "{\"lumi\": " << lumi << ",\n";
-  out << "\"bins\":[\n";
-  bool first = true;
-  for (const auto& var : vars) {
-    if (!first) out << ",\n";
-    out << "[\"" << var.name << "\",[\n";
-    first = true;
-    for (const auto& x : var.edges) {
-      if (first) first = false;
-      else out << ',';
-      out << x;
-    }
-    out << "\n]]";
+  if (auto_prec) {
+    std::ofstream f(out_pattern);
+    for (size_t c=0; c<configs.size(); ++c) {
+      if (configs.size() > 1)
+        f << (c ? "\n[" : "[") << configs[c].name << "]\n";
+      for (size_t v=0; v<configs[c].vars.size(); ++v) {
+        const auto& var = configs[c].vars[v];
+        sketch &d = data_sk[c][v], &m = mc_sk[c][v];
+        const bool range = var.edges.size() > 1;
+        const auto edges = auto_edges(d,m,auto_prec,
+          range ? var.edges.front() : std::min(d.min(),m.min()),
+          range ? var.edges.back() : inf);
+        f << var.name << ':';
+        for (double x : edges) f << ' ' << x;
+        f << '\n';
+      }
+    }
+    f.close();
+    if (!f) {
+      cerr << "\033[31mfailed to write \"" << out_pattern << "\"\033[0m\n";
+      return 1;
+    }
+    return 0;
   }
-  out << '\n';
-  for (bool is_mc : {false,true}) {
-    out << "],\n\"" << (is_mc ? "mc" : "data") << "\":[\n";
-    first = true;
-    for (const auto& bin : (is_mc ? mc : data)) {
-      if (first) first = false;
-      else out << ",\n";
-      out << '[' << bin.w << ',' << std::sqrt(bin.w2) << ']';
-    }
-    out << '\n';
+
+  for (size_t c=0; c<configs.size(); ++c) {
+    const std::string fname = config_file(out_pattern,c);
+    hist_output out;
+    out.lumi = lumi;
+    out.nbins = configs[c].nbins;
+    for (const auto& var : configs[c].vars)
+      out.vars.push_back({var.name,var.edges});
+    out.hists.push_back({"data",&data[c],0});
+    out.hists.push_back({"mc",&mc[c],0});
+    const unsigned nw = mc[c].nweights() - nboot;
+    for (unsigned i=1; i<nw; ++i) // weight variations
+      out.hists.push_back({weight_names[i],&mc[c],i});
+    for (unsigned r=0; r<nboot; ++r) // bootstrap replicas
+      out.hists.push_back({"data/boot/"+std::to_string(r),&data[c],1+r});
+    for (unsigned r=0; r<nboot; ++r)
+      out.hists.push_back({"mc/boot/"+std::to_string(r),&mc[c],nw+r});
+    if (states.size()) {
+      out.add(*states[c],config_file(state_pattern,c));
+      states[c].reset();
+    }
+    out.inputs.insert(out.inputs.end(),new_inputs.begin(),new_inputs.end());
+    out.write(fname);
+    if (configs.size() > 1) cout << fname << endl;
   }
-  out << "]\n}" << std::flush;
 }
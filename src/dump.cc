@@ -9,6 +9,7 @@
 #include <vector>
 
 #include "ivanp/error.hh"
+#include "schema.hh"
 
 #define TEST(var) \
   std::cout << "\033[36m" #var "\033[0m = " << var << std::endl;
@@ -19,7 +20,8 @@ using std::cerr;
 using namespace ivanp;
 
 class file {
-  char *m, *pos, *end;
+  char *m;
+  const char *pos, *end;
 public:
   file(const char* name) {
     struct stat sb;
@@ -35,15 +37,12 @@ public:
     end = m + len;
   }
   ~file() { munmap(m,end-m); }
-  char get() { return *(pos++); }
-  template <typename T>
-  friend inline file& operator>>(file& f, T& x) {
-    memcpy(reinterpret_cast<char*>(&x),f.pos,sizeof(x));
-    f.pos += sizeof(x);
-    return f;
+  dat_schema schema() { return { pos, end }; }
+  template <typename Decoder>
+  void operator()(const Decoder& decode, dat_event& e) {
+    pos = decode(pos,e);
   }
   operator bool() const { return pos!=end; }
-  void skip(size_t off) { pos += off; }
 };
 
 int main(int argc, char* argv[]) {
@@ -53,30 +52,18 @@ int main(int argc, char* argv[]) {
   }
 
   file dat(argv[1]);
-  for (int nbraces=0;;) { // skip header
-    if (!dat) {
-      cerr << "file ended in header\n";
-      return 1;
-    }
-    const char c = dat.get();
-    if (c=='{') ++nbraces;
-    else if (c=='}') --nbraces;
-    if (!nbraces) break;
-  }
+  const dat_schema schema = dat.schema();
 
-  uint32_t runNumber;
-  uint64_t eventNumber;
-  uint32_t njets;
-  float mom[4];
+  dat_event ev;
 
   cout.fill('0');
-  for (;dat;) {
-    dat >> runNumber >> eventNumber;
-    cout << std::setw(8) << runNumber << ' '
-         << std::setw(11) << eventNumber << '\n';
-
-    dat.skip(sizeof(mom)*2);
-    dat >> njets;
-    dat.skip(sizeof(mom)*njets);
-  }
+  dispatch(schema,[&](auto decode){
+    if constexpr (!decltype(decode)::has_event_number)
+      throw error("no event numbers in \"",argv[1],'\"');
+    else for (;dat;) {
+      dat(decode,ev);
+      cout << std::setw(8) << ev.runNumber << ' '
+           << std::setw(11) << ev.eventNumber << '\n';
+    }
+  });
 }
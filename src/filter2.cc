@@ -1,9 +1,12 @@
 #include <iostream>
 #include <fstream>
+#include <vector>
+#include <cstring>
 
 #include "ivanp/math/vec4.hh"
 #include "ivanp/timed_counter.hh"
 #include "reader2.hh"
+#include "writer2.hh"
 
 #define TEST(var) \
   std::cout << "\033[36m" #var "\033[0m = " << var << std::endl;
@@ -15,75 +18,83 @@ using std::cerr;
 using vec4 = ivanp::vec4<double>;
 using mom_t = float[4];
 
-float lumi=0, weight=1;
+float lumi=0;
 uint32_t nevents_total=0, nevents=0;
 mom_t mom;
 uint8_t njets = 0;
 
 int main(int argc, char* argv[]) {
   if (argc!=3) {
-    cout << "usage: " << argv[0] << " in.dat out.dat\n";
+    cout << "usage: " << argv[0] << " in.dat out.dat\n"
+            "  in.dat can be a comma separated list or glob\n"
+            "  - reads stdin or writes stdout\n";
     return 1;
   }
-  reader read(argv[1]);
+  // messages go to stderr when writing to stdout
+  const bool to_stdout = !strcmp(argv[2],"-");
+  std::ofstream file;
+  if (!to_stdout) file.open(argv[2]);
+  std::ostream out(to_stdout ? cout.rdbuf() : file.rdbuf());
+  if (to_stdout) cout.rdbuf(cerr.rdbuf());
 
-  std::ofstream out(argv[2]);
-  auto write = [&out](const auto& x){
-    out.write(reinterpret_cast<const char*>(&x),sizeof(x));
-  };
+  dataset read(argv[1]);
 
-  char dm;
-  const bool is_mc = read(dm) == 'm';
-  TEST(dm)
-  write(dm);
+  const bool is_mc = read.is_mc();
+  TEST(is_mc)
   if (!is_mc) {
-    read(lumi);
+    lumi = read.lumi();
     TEST(lumi);
-    write(lumi);
-    weight = 1;
   }
-  read(nevents_total);
+  nevents_total = read.nevents();
   TEST(nevents_total);
 
-  const auto nevents_pos = out.tellp();
-  write(nevents);
+  writer write(out, is_mc, lumi, read.format());
 
   mom_t ph[2];
-  { ivanp::timed_counter<> ent;
-    for (; read; ++ent) {
-      if (is_mc) read(weight);
-      read(ph);
-      read(njets);
-
-      const vec4 diph
-        = vec4(ph[0],vec4::PtEtaPhiM_t{})
-        + vec4(ph[1],vec4::PtEtaPhiM_t{});
-      const double myy = diph.m();
-
-      if (121<myy && myy<129) {
-        ++nevents;
-        if (is_mc) write(weight);
-        write(ph[0]);
-        write(ph[1]);
-        write(njets);
+  auto pass = [](const mom_t* ph){
+    const vec4 diph
+      = vec4(ph[0],vec4::PtEtaPhiM_t{})
+      + vec4(ph[1],vec4::PtEtaPhiM_t{});
+    const double myy = diph.m();
+    return 121<myy && myy<129;
+  };
 
-        if (njets>4) njets = 4;
-        for (decltype(njets) i=0; i<njets; ++i)
-          write(read(mom));
-      } else {
-        if (njets>4) njets = 4;
-        read.skip(sizeof(mom_t)*njets);
+  { ivanp::timed_counter<> ent;
+    // columnar files: the cut reads only the photon columns,
+    // and only selected events are gathered into records
+    if (read.format().columnar)
+    for (hgam_columns c; read.next(c); ) {
+      for (uint32_t i=0, j=0; i<c.n; ++i, ++ent) {
+        njets = c.njets[i];
+        const unsigned nstored = njets>4 ? 4 : njets;
+        for (int k=0; k<2; ++k)
+          for (int a=0; a<4; ++a) ph[k][a] = c.y[k][a][i];
+        if (pass(ph)) {
+          for (auto* w : c.weight) write(w[i]);
+          write(ph[0]);
+          write(ph[1]);
+          write(njets);
+          for (unsigned k=0; k<nstored; ++k) {
+            for (int a=0; a<4; ++a) mom[a] = c.jets[a][j+k];
+            write(mom);
+          }
+          write.end_event();
+        }
+        j += nstored;
       }
     }
+    else for (hgam_event e; read.next(e); ++ent) {
+      memcpy(ph,e.y[0],sizeof(mom_t));
+      memcpy(ph+1,e.y[1],sizeof(mom_t));
+      if (pass(ph)) write.event(e.data(),e.size());
+    }
+    nevents_total = read.nevents(); // known at the end for streams
     if (ent!=nevents_total) {
       cerr << "\033[31m" << nevents_total << " expected, "
         << ent << " events read\033[0m" << endl;
     }
   }
+  write.close();
+  nevents = write.nevents();
   TEST(nevents)
-
-  out.flush();
-  out.seekp(nevents_pos);
-  write(nevents);
-  out.flush();
 }
@@ -0,0 +1,45 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "hist_io.hh"
+
+#define TEST(var) \
+  std::cout << "\033[36m" #var "\033[0m = " << var << std::endl;
+
+using std::cout;
+using std::endl;
+using std::cerr;
+
+// adds up .bin histogram states of separate bin2 runs
+// the inputs of the states must not overlap
+int main(int argc, char* argv[]) {
+  if (argc<3) {
+    cout << "usage: " << argv[0] << " out.bin in.bin ...\n"
+            "  output not ending in .bin is written as JSON\n";
+    return 1;
+  }
+
+  std::vector<std::unique_ptr<hist_file>> in;
+  for (int i=2; i<argc; ++i)
+    in.push_back(std::make_unique<hist_file>(argv[i]));
+
+  // sum into the histograms of the first file
+  hist_file& first = *in.front();
+  hist_output out;
+  out.nbins = first.nbins;
+  out.vars = first.vars;
+  for (auto& [name, h] : first.hists) out.hists.push_back({name,&h,0});
+  out.inputs = first.inputs;
+  out.lumi = first.lumi;
+  for (size_t i=1; i<in.size(); ++i) {
+    out.add(*in[i],argv[i+2]);
+    out.lumi += in[i]->lumi;
+    in[i].reset();
+  }
+  TEST(out.lumi)
+  TEST(out.inputs.size())
+
+  out.write(argv[1]);
+}
@@ -0,0 +1,78 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cstring>
+
+#include "ivanp/io/mem_file.hh"
+#include "reader2.hh"
+
+#define TEST(var) \
+  std::cout << "\033[36m" #var "\033[0m = " << var << std::endl;
+
+using std::cout;
+using std::endl;
+using std::cerr;
+
+// writes the event index sidecar <file>.idx for v2 files
+// so that readers can start at any event without scanning
+int main(int argc, char* argv[]) {
+  if (argc<2) {
+    cout << "usage: " << argv[0] << " file.dat [stride]\n";
+    return 1;
+  }
+  const uint32_t stride = argc>2 ? atoi(argv[2]) : hgam_default_index_stride;
+  if (!stride) {
+    cerr << "\033[31mstride must be positive\033[0m\n";
+    return 1;
+  }
+
+  unsigned nweights;
+  { reader read(argv[1]);
+    nweights = read.nweights();
+    if (read.version()==3) {
+      cout << argv[1] << " has a block index: "
+           << read.nblocks() << " blocks of "
+           << read.block_size() << " events" << endl;
+      return 0;
+    }
+  }
+
+  const auto f = ivanp::mem_file::mmap(argv[1]);
+  const char *p = f.mem(), *end = p + f.size();
+  const bool is_mc = *p++=='m';
+  if (!is_mc) p += sizeof(float); // lumi
+  uint32_t nevents;
+  memcpy(&nevents,p,sizeof(nevents));
+  p += sizeof(nevents);
+  TEST(nevents)
+
+  std::vector<uint64_t> offsets;
+  offsets.reserve(nevents/stride + 1);
+  uint32_t n = 0;
+  for (; p < end; ++n) {
+    if (n%stride==0) offsets.push_back(p - f.mem());
+    p += record_size(p, nweights);
+  }
+  if (p!=end || n!=nevents) {
+    cerr << "\033[31m" << argv[1] << " is corrupt\033[0m\n";
+    return 1;
+  }
+
+  const std::string name = ivanp::cat(argv[1],".idx");
+  std::ofstream out(name, std::ios::binary);
+  auto write = [&out](const auto& x){
+    out.write(reinterpret_cast<const char*>(&x),sizeof(x));
+  };
+  out.write(hgam_index_magic,4);
+  write(stride);
+  write(nevents);
+  write(uint64_t(f.size()));
+  for (auto x : offsets) write(x);
+  out.close();
+  if (!out) {
+    cerr << "\033[31mfailed to write " << name << "\033[0m\n";
+    return 1;
+  }
+  cout << name << ": " << offsets.size() << " offsets" << endl;
+}
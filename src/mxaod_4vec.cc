@@ -11,6 +11,7 @@
 #include "ivanp/timed_counter.hh"
 #include "ivanp/error.hh"
 #include "ivanp/root/branch_reader.hh"
+#include "schema.hh"
 
 #define TEST(var) \
   std::cout << "\033[36m" #var "\033[0m = " << var << std::endl;
@@ -33,13 +34,6 @@ inline unsigned find(const C& c, const T& x) {
   return std::distance(_begin,it);
 }
 
-template <typename T>
-std::string type_name() {
-  return (std::is_floating_point<T>::value ? "f" :
-      (std::is_signed<T>::value ? "i" : "u")
-    ) + std::to_string(sizeof(T));
-}
-
 int main(int argc, char* argv[]) {
   std::stringstream out;
   auto write = [&out](const auto& x){
@@ -127,14 +121,8 @@ int main(int argc, char* argv[]) {
   }
   TEST(n_events)
 
+  static_assert(sizeof(UInt_t)==4 && sizeof(ULong64_t)==8 &&
+                sizeof(float_t)==4 && sizeof(size_type)==4);
   std::ofstream("data.dat")
-    << R"({"root":[["event#)"
-    << n_events
-    << R"(","events"]],"types":{"event":[)"
-    << "[\"" << type_name<UInt_t>() << "\",\"runNumber\"],"
-    << "[\"" << type_name<ULong64_t>() << "\",\"eventNumber\"],"
-    << R"(["4vec#2","photons"],["4vec#","jets"]],"4vec":[[")"
-    << type_name<float_t>()
-    << R"(","pt","eta","phi","m"]]}})"
-    << out.rdbuf();
+    << mxaod_4vec_schema_json(n_events) << out.rdbuf();
 }
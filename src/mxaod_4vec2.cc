@@ -1,21 +1,33 @@
 #include <iostream>
+#include <cstdio>
 #include <fstream>
 #include <algorithm>
 #include <array>
 #include <numeric>
 #include <vector>
+#include <map>
 #include <string>
 #include <memory>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <exception>
+#include <filesystem>
+#include <future>
+#include <functional>
 
 #include <nlohmann/json.hpp>
 #include <TFile.h>
 #include <TH1.h>
 #include <TKey.h>
+#include <TROOT.h>
+#include <TTreeCache.h>
 
-#include "ivanp/timed_counter.hh"
 #include "ivanp/error.hh"
 #include "ivanp/pcre_wrapper.hh"
-#include "ivanp/root/branch_reader.hh"
+#include "ivanp/io/mem_file.hh"
+#include "bulk_branch.hh"
+#include "writer2.hh"
 
 #define TEST(var) \
   std::cout << "\033[36m" #var "\033[0m = " << var << std::endl;
@@ -27,14 +39,12 @@ using std::string;
 using std::vector;
 using ivanp::error;
 using ivanp::cat;
-using ivanp::branch_reader;
 
 using float_t = float;
 
-template <typename C, typename T>
-unsigned find(const C& c, const T& x) {
-  const auto _begin = begin(c);
-  const auto _end = end(c);
+template <typename T>
+unsigned find(const T* _begin, unsigned n, const T& x) {
+  const T* _end = _begin + n;
   const auto it = std::find(_begin,_end,x);
   if (it==_end) throw error(x," not found");
   return std::distance(_begin,it);
@@ -51,11 +61,297 @@ struct set {
   double lumi = 0;
 };
 
+// branches read by convert
+const char* const event_branches[] {
+  "HGamEventInfoAuxDyn.isPassed",
+  "HGamEventInfoAuxDyn.m_yy",
+  "HGamEventInfoAuxDyn.pT_y1",
+  "HGamEventInfoAuxDyn.pT_y2",
+  "HGamPhotonsAuxDyn.pt",
+  "HGamPhotonsAuxDyn.eta",
+  "HGamPhotonsAuxDyn.phi",
+  "HGamPhotonsAuxDyn.m",
+  "HGamAntiKt4EMTopoJetsAuxDyn.pt",
+  "HGamAntiKt4EMTopoJetsAuxDyn.eta",
+  "HGamAntiKt4EMTopoJetsAuxDyn.phi",
+  "HGamAntiKt4EMTopoJetsAuxDyn.m"
+};
+const char* const mc_branches[] {
+  "HGamEventInfoAuxDyn.crossSectionBRfilterEff"
+};
+
+// MC weight, product of HGamEventInfoAuxDyn branches,
+// scalars or elements of vectors, e.g. "weight*weightSF" or "weights[3]"
+// every weight is also multiplied by crossSectionBRfilterEff and lumi
+struct weight_def {
+  string name;
+  vector<std::pair<unsigned,int>> factors; // branch, index or -1
+};
+struct weight_defs {
+  vector<weight_def> defs;
+  vector<string> branches;
+
+  weight_defs(const vector<string>& specs) {
+    for (const auto& spec : specs) {
+      defs.push_back({spec});
+      for (size_t a=0, b; a<=spec.size(); a=b+1) {
+        b = std::min(spec.find('*',a),spec.size());
+        string f = spec.substr(a,b-a);
+        f.erase(std::remove(f.begin(),f.end(),' '),f.end());
+        int index = -1;
+        if (const auto i = f.find('['); i!=string::npos) {
+          if (f.back()!=']') throw error("bad weight \"",spec,'\"');
+          index = std::stoi(f.substr(i+1));
+          f.erase(i);
+        }
+        if (f.empty()) throw error("bad weight \"",spec,'\"');
+        f = "HGamEventInfoAuxDyn." + f;
+        auto it = std::find(branches.begin(),branches.end(),f);
+        if (it==branches.end()) it = branches.insert(it,f);
+        defs.back().factors.emplace_back(it-branches.begin(),index);
+      }
+    }
+  }
+};
+
+// opened MxAOD, with TTreeCache restricted to the branches read
+struct input {
+  std::unique_ptr<TFile> file;
+  TTree* tree = nullptr;
+  double n_all = 0; // MC CutFlow normalization
+};
+
+// open and fill the cache with the first cluster
+// runs asynchronously while the previous input is converted
+input open_input(
+  const string& fname, bool is_mc, Long64_t cache_size,
+  const weight_defs& weights
+) {
+  input in;
+  in.file.reset(TFile::Open(fname.c_str()));
+  if (!in.file || in.file->IsZombie())
+    throw error("cannot open \"",fname,'\"');
+
+  if (is_mc) { // MC
+    for (auto* key : *in.file->GetListOfKeys()) {
+      const char* name = key->GetName();
+      if (!ivanp::starts_with(name,"CutFlow_") ||
+          !ivanp::ends_with(name,"_noDalitz_weighted")) continue;
+      TH1 *h = static_cast<TH1*>(static_cast<TKey*>(key)->ReadObj());
+      in.n_all = h->GetBinContent(3);
+      break;
+    }
+    if (in.n_all==0) throw error("no CutFlow histogram in \"",fname,'\"');
+  }
+
+  auto*& tree = in.tree;
+  in.file->GetObject("CollectionTree",tree);
+  if (!tree) throw error("no CollectionTree in \"",fname,'\"');
+
+  tree->SetCacheSize(cache_size);
+  for (const char* name : event_branches) tree->AddBranchToCache(name,true);
+  if (is_mc) {
+    for (const char* name : mc_branches) tree->AddBranchToCache(name,true);
+    for (const auto& name : weights.branches)
+      tree->AddBranchToCache(name.c_str(),true);
+  }
+  tree->StopCacheLearningPhase();
+
+  if (tree->GetEntries() > 0)
+    get_branch(tree,event_branches[0])->GetEntry(0);
+
+  return in;
+}
+
+// convert one MxAOD, writing event records to out
+// returns number of events after cuts
+uint32_t convert(
+  input& in, bool is_mc, double lumi_frac, const weight_defs& weights,
+  std::ostream& out
+) {
+  auto write = [&out](const auto& x){
+    out.write(reinterpret_cast<const char*>(&x),sizeof(x));
+  };
+
+  uint32_t nevents = 0;
+  const double mc_factor = is_mc ? 1e3*lumi_frac/in.n_all : 0;
+  std::vector<unsigned> ph_i(2), jet_i;
+  TTree* const tree = in.tree;
+  const char* const fname = in.file->GetName();
+
+  using float_branch = scalar_branch<float_t>;
+  using floats_branch = vector_branch<float_t>;
+
+  scalar_branch<Char_t> _isPassed(tree,"HGamEventInfoAuxDyn.isPassed");
+  float_branch _m_yy(tree,"HGamEventInfoAuxDyn.m_yy");
+  std::array<float_branch,2> _pT_y {{
+    {tree,"HGamEventInfoAuxDyn.pT_y1"},
+    {tree,"HGamEventInfoAuxDyn.pT_y2"}
+  }};
+  std::array<floats_branch,4> _photons {{
+    {tree,"HGamPhotonsAuxDyn.pt"},
+    {tree,"HGamPhotonsAuxDyn.eta"},
+    {tree,"HGamPhotonsAuxDyn.phi"},
+    {tree,"HGamPhotonsAuxDyn.m"}
+  }};
+  std::array<floats_branch,4> _jets {{
+    {tree,"HGamAntiKt4EMTopoJetsAuxDyn.pt"},
+    {tree,"HGamAntiKt4EMTopoJetsAuxDyn.eta"},
+    {tree,"HGamAntiKt4EMTopoJetsAuxDyn.phi"},
+    {tree,"HGamAntiKt4EMTopoJetsAuxDyn.m"}
+  }};
+
+  // MC
+  std::unique_ptr<float_branch> _cs_br_fe;
+  const unsigned nwb = is_mc ? weights.branches.size() : 0;
+  vector<std::unique_ptr<float_branch>> _weight(nwb);
+  vector<std::unique_ptr<floats_branch>> _weights(nwb);
+  if (is_mc) {
+    make(_cs_br_fe,tree,"HGamEventInfoAuxDyn.crossSectionBRfilterEff");
+    for (const auto& w : weights.defs)
+      for (const auto& [b, index] : w.factors) {
+        const char* name = weights.branches[b].c_str();
+        if (index < 0) { if (!_weight[b]) make(_weight[b],tree,name); }
+        else if (!_weights[b]) make(_weights[b],tree,name);
+        if (_weight[b] && _weights[b]) throw error(
+          "weight branch ",name," used as both scalar and vector");
+      }
+  }
+
+  // per-cluster buffers
+  vector<Char_t> isPassed;
+  vector<float_t> m_yy, pT_y[2], cs_br_fe;
+  std::array<jagged<float_t>,4> photons, jets;
+  vector<vector<float_t>> weight(nwb);
+  vector<jagged<float_t>> weight_vec(nwb);
+  vector<Long64_t> sel;
+
+  const Long64_t nentries = tree->GetEntries();
+  auto clusters = tree->GetClusterIterator(0);
+  for (Long64_t first; (first = clusters.Next()) < nentries; ) {
+    const Long64_t last = std::min(clusters.GetNextEntry(),nentries);
+
+    // cuts over the whole cluster
+    _isPassed.read(first,last,isPassed);
+    _m_yy.read(first,last,m_yy);
+    sel.clear();
+    for (Long64_t i=0, n=last-first; i<n; ++i) {
+      if (!isPassed[i]) continue;
+      // diphoton mass cut
+      const double m = m_yy[i]*1e-3;
+      if (m<105. || 160.<m) continue;
+      sel.push_back(first+i);
+    }
+    if (sel.empty()) continue;
+    nevents += sel.size(); // number of events after cuts
+
+    // read the rest only for selected entries
+    for (int i=0; i<2; ++i) _pT_y[i].read(sel,pT_y[i]);
+    for (int i=0; i<4; ++i) _photons[i].read(sel,photons[i]);
+    for (int i=0; i<4; ++i) _jets[i].read(sel,jets[i]);
+    if (is_mc) {
+      _cs_br_fe->read(sel,cs_br_fe);
+      for (unsigned b=0; b<nwb; ++b) {
+        if (_weight[b]) _weight[b]->read(sel,weight[b]);
+        else _weights[b]->read(sel,weight_vec[b]);
+      }
+    }
+
+    for (size_t e=0; e<sel.size(); ++e) {
+      if (is_mc) for (const auto& w : weights.defs) {
+        double x = 1;
+        for (const auto& [b, index] : w.factors) {
+          if (index < 0) x *= weight[b][e];
+          else if (unsigned(index) < weight_vec[b].size(e))
+            x *= weight_vec[b][e][index];
+          else throw error(
+            "weight ",w.name," out of range in \"",fname,'\"');
+        }
+        write(float_t(x * double(cs_br_fe[e]) * mc_factor));
+      }
+
+      const float_t* const photon_pt = photons[0][e];
+      const auto nphotons = photons[0].size(e);
+
+      auto pT_y1 = pT_y[0][e], pT_y2 = pT_y[1][e];
+      if (pT_y1 < pT_y2) std::swap(pT_y1,pT_y2);
+      try {
+        ph_i = {
+          find(photon_pt,nphotons,pT_y1),
+          find(photon_pt,nphotons,pT_y2)
+        };
+        if (ph_i[0]==ph_i[1]) throw error("same index");
+      } catch (const std::exception& e) {
+        throw error("Photons: ",e.what()," in \"",fname,'\"');
+      }
+
+      const float_t* const jet_pt = jets[0][e];
+      const float_t* const jet_eta = jets[1][e];
+
+      jet_i.resize(jets[0].size(e));
+      if (jet_i.size()) {
+        std::iota(jet_i.begin(), jet_i.end(), 0);
+        std::sort(jet_i.begin(), jet_i.end(), [&](auto a, auto b){
+          return jet_pt[a] > jet_pt[b];
+        });
+        // jet pT cut
+        while (jet_i.size() && jet_pt[jet_i.back()] < 30e3)
+          jet_i.pop_back();
+        // jet eta cut
+        jet_i.erase(std::remove_if( jet_i.begin(), jet_i.end(),
+          [&](const auto& i) { return std::abs(jet_eta[i]) > 4.4; }),
+          jet_i.end());
+      }
+
+      for (auto i : ph_i) {
+        write(float_t(photons[0][e][i]*1e-3));
+        write(photons[1][e][i]);
+        write(photons[2][e][i]);
+        write(float_t(photons[3][e][i]*1e-3));
+      }
+
+      const uint8_t njets = jet_i.size();
+      write(njets);
+      if (njets > 4) jet_i.resize(4);
+      for (auto i : jet_i) {
+        write(float_t(jets[0][e][i]*1e-3));
+        write(jets[1][e][i]);
+        write(jets[2][e][i]);
+        write(float_t(jets[3][e][i]*1e-3));
+      }
+    }
+  }
+
+  return nevents;
+}
+
 int main(int argc, char* argv[]) {
+  // argv[4]: data or mc, merge only that to stdout, for a pipe
+  // messages then go to stderr
+  const string to_stdout = argc>4 ? argv[4] : "";
+  if (to_stdout.size() && to_stdout!="data" && to_stdout!="mc")
+    throw error("expected data or mc, not \"",to_stdout,'\"');
+  std::ostream stdout_stream(cout.rdbuf());
+  if (to_stdout.size()) cout.rdbuf(cerr.rdbuf());
+
   vector<set> sets;
+  hgam_format format; // output
+  vector<string> weight_specs { "weight" };
+  Long64_t cache_size = 0; // TTreeCache per input
   { nlohmann::json cfg;
     std::ifstream(argc>2 && strlen(argv[2]) ? argv[2] : "mxaods2.json") >> cfg;
     const string dir = cfg["dir"];
+    format.columnar = cfg.value("columnar",false);
+    format.compressed = cfg.value("compressed",false);
+    // events per block, also the granularity of the block index
+    format.block_size = cfg.value("block_size",hgam_default_block_size);
+    if (!format.block_size) throw error("block_size must be positive");
+    if (cfg.contains("weights")) {
+      weight_specs = cfg["weights"].get<vector<string>>();
+      if (weight_specs.empty()) throw error("no weights");
+      format.weights = weight_specs;
+    }
+    cache_size = Long64_t(cfg.value("cache_mb",100)) << 20;
     for (const auto& [set_name, set] : cfg["sets"].items()) {
       sets.emplace_back();
       auto& s = sets.back();
@@ -88,6 +384,8 @@ int main(int argc, char* argv[]) {
     }
   }
 
+  const weight_defs weights(weight_specs);
+
   double total_lumi = 0;
   for (const auto& s : sets) total_lumi += s.lumi;
   TEST(total_lumi)
@@ -105,148 +403,215 @@ int main(int argc, char* argv[]) {
   }
   */
 
-  double mc_factor = 0;
-  std::vector<unsigned> ph_i(2), jet_i;
+  namespace fs = std::filesystem;
 
-  for (const bool is_mc : {false,true}) {
+  // one job per input file, in the order of the serial conversion
+  struct job {
+    const set* s;
+    const string* fname;
+    bool is_mc;
+    string shard; // relative to out_dir
     uint32_t nevents = 0;
-
-    std::ofstream out(cat(
-      ( argc>1 && strlen(argv[1]) ? argv[1] : "." ),
-      "/hgam_", (is_mc?"mc":"data"), ".dat"
-    ));
-    auto write = [&out](const auto& x){
-      out.write(reinterpret_cast<const char*>(&x),sizeof(x));
-    };
-
-    if (is_mc) {
-      out << 'm';
-    } else {
-      out << 'd';
-      write(float_t(total_lumi*1e-3));
+    double norm = 0; // MC CutFlow normalization
+    bool done = false;
+  };
+  vector<job> jobs;
+  for (const bool is_mc : {false,true})
+    for (const auto& s : sets)
+      for (const auto& fname : (is_mc ? s.mc : s.data))
+        jobs.push_back({ &s, &fname, is_mc });
+
+  const string out_dir = argc>1 && strlen(argv[1]) ? argv[1] : ".";
+  fs::create_directories(out_dir+"/shards");
+  // shards are named by input stem and a hash of the canonical path,
+  // so inputs with the same name in different directories are kept apart
+  { std::map<string,std::pair<string,const string*>> shards;
+    for (auto& j : jobs) {
+      const string path = fs::weakly_canonical(*j.fname).string();
+      uint32_t h = 2166136261u; // FNV-1a
+      for (unsigned char c : path) h = (h ^ c) * 16777619u;
+      char hex[9];
+      snprintf(hex,sizeof(hex),"%08x",h);
+      j.shard = cat("shards/",fs::path(*j.fname).stem().string(),
+                    '_',hex,".dat");
+      const auto [it, added] =
+        shards.emplace(j.shard,std::pair(path,j.fname));
+      if (!added) throw error(
+        "inputs \"",*it->second.second,"\" and \"",*j.fname,"\" ",
+        it->second.first==path ? "are the same file"
+          : cat("would both be converted to \"",j.shard,'\"'));
     }
+  }
 
-    const auto nevents_pos = out.tellp();
-    write(nevents);
-
-    for (const auto& s : sets) {
-    for (const auto& fname : (is_mc ? s.mc : s.data)) {
-      TEST(fname);
-      TFile fin(fname.c_str());
-
-      if (is_mc) { // MC
-        for (auto* key : *fin.GetListOfKeys()) {
-          const char* name = key->GetName();
-          if (!ivanp::starts_with(name,"CutFlow_") ||
-              !ivanp::ends_with(name,"_noDalitz_weighted")) continue;
-          TH1 *h = static_cast<TH1*>(static_cast<TKey*>(key)->ReadObj());
-          cout << name << endl;
-          const double n_all = h->GetBinContent(3);
-          cout << h->GetXaxis()->GetBinLabel(3) << " = " << n_all << endl;
-          mc_factor = 1e3*(s.lumi/total_lumi)/n_all;
-          break;
-        }
-      }
-
-      TTreeReader reader("CollectionTree",&fin);
-      branch_reader<Char_t> isPassed(reader,"HGamEventInfoAuxDyn.isPassed");
-      std::array<branch_reader<std::vector<float_t>>,4> _photons {{
-        {reader,"HGamPhotonsAuxDyn.pt"},
-        {reader,"HGamPhotonsAuxDyn.eta"},
-        {reader,"HGamPhotonsAuxDyn.phi"},
-        {reader,"HGamPhotonsAuxDyn.m"}
-      }};
-      std::array<branch_reader<std::vector<float_t>>,4> _jets {{
-        {reader,"HGamAntiKt4EMTopoJetsAuxDyn.pt"},
-        {reader,"HGamAntiKt4EMTopoJetsAuxDyn.eta"},
-        {reader,"HGamAntiKt4EMTopoJetsAuxDyn.phi"},
-        {reader,"HGamAntiKt4EMTopoJetsAuxDyn.m"}
-      }};
-
-      using float_branch = branch_reader<float_t>;
-
-      std::array<float_branch,2> _pT_y {{
-        {reader,"HGamEventInfoAuxDyn.pT_y1"},
-        {reader,"HGamEventInfoAuxDyn.pT_y2"}
-      }};
-      float_branch _m_yy(reader,"HGamEventInfoAuxDyn.m_yy");
-
-      // MC
-      std::unique_ptr<float_branch> _weight, _cs_br_fe;
-      if (is_mc) {
-        make(_weight,reader,"HGamEventInfoAuxDyn.weight");
-        make(_cs_br_fe,reader,"HGamEventInfoAuxDyn.crossSectionBRfilterEff");
-      }
-
-      for ( ivanp::timed_counter<Long64_t> ent(reader.GetEntries(true));
-            reader.Next(); ++ent)
-      {
-        if (!*isPassed) continue;
-
-        // diphoton mass cut
-        const double m_yy = *_m_yy*1e-3;
-        if (m_yy<105. || 160.<m_yy) continue;
-
-        ++nevents; // number of events after cuts
-
-        if (is_mc) {
-          write( float_t( // weight
-            double(**_weight) * double(**_cs_br_fe) * mc_factor
-          ));
-        }
-
-        const auto& photon_pt = *_photons[0];
+  // manifest of converted inputs -----------------------------------
+  // a shard is reused if its input has the same size and mtime
+  // and was converted with the same lumi weights and MC weights
+  const string manifest_name = out_dir + "/hgam_manifest.json";
+  nlohmann::json manifest;
+  if (fs::exists(manifest_name)) std::ifstream(manifest_name) >> manifest;
+  auto& entries = manifest["files"];
+  if (entries.is_null()) entries = nlohmann::json::object();
+
+  auto input_stat = [](const string& fname) {
+    return std::make_pair(
+      fs::file_size(fname),
+      fs::last_write_time(fname).time_since_epoch().count()
+    );
+  };
+
+  for (auto& j : jobs) {
+    const auto it = entries.find(*j.fname);
+    if (it==entries.end()) continue;
+    const auto& e = *it;
+    std::error_code ec;
+    const auto [size, mtime] = input_stat(*j.fname);
+    if ( e.at("size")!=size || e.at("mtime")!=mtime ||
+         (j.is_mc && ( e.at("lumi")!=j.s->lumi ||
+                       e.at("total_lumi")!=total_lumi ||
+                       e.value("weights",vector<string>{"weight"})
+                         !=weight_specs )) ||
+         e.at("shard")!=j.shard ||
+         fs::file_size(out_dir+'/'+j.shard,ec)!=e.at("shard_size") ) continue;
+    j.nevents = e.at("nevents");
+    j.norm = e.at("norm");
+    j.done = true;
+  }
 
-        auto pT_y1 = *_pT_y[0], pT_y2 = *_pT_y[1];
-        if (pT_y1 < pT_y2) std::swap(pT_y1,pT_y2);
-        try {
-          ph_i = { find(photon_pt,pT_y1), find(photon_pt,pT_y2) };
-          if (ph_i[0]==ph_i[1]) throw error("same index");
-        } catch (const std::exception& e) {
-          cerr << "Photons: " << e << '\n';
-          return 1;
-        }
+  // drop stale entries and shards
+  for (auto it=entries.begin(); it!=entries.end(); ) {
+    if (std::find_if(jobs.begin(),jobs.end(),[&](const auto& j){
+      return j.done && *j.fname==it.key();
+    })==jobs.end()) {
+      const string shard = it->value("shard","");
+      if (std::find_if(jobs.begin(),jobs.end(),[&](const auto& j){
+        return j.shard==shard;
+      })==jobs.end()) fs::remove(out_dir+'/'+shard);
+      it = entries.erase(it);
+    } else ++it;
+  }
 
-        const auto& jet_pt = *_jets[0];
-
-        jet_i.resize(jet_pt.size());
-        if (jet_i.size()) {
-          std::iota(jet_i.begin(), jet_i.end(), 0);
-          std::sort(jet_i.begin(), jet_i.end(), [&](auto a, auto b){
-            return jet_pt[a] > jet_pt[b];
-          });
-          // jet pT cut
-          while (jet_i.size() && jet_pt[jet_i.back()] < 30e3)
-            jet_i.pop_back();
-          // jet eta cut
-          jet_i.erase(std::remove_if( jet_i.begin(), jet_i.end(),
-            [&](const auto& i) { return std::abs((*_jets[1])[i]) > 4.4; }),
-            jet_i.end());
-        }
+  auto write_manifest = [&]{ // replace atomically
+    const string tmp = manifest_name + ".tmp";
+    std::ofstream(tmp) << manifest.dump(1) << '\n';
+    fs::rename(tmp,manifest_name);
+  };
+  write_manifest();
+
+  vector<job*> todo;
+  for (auto& j : jobs)
+    if (!j.done) todo.push_back(&j);
+  cout << (jobs.size()-todo.size()) << " of " << jobs.size()
+       << " inputs up to date" << endl;
+
+  // convert --------------------------------------------------------
+  unsigned nthreads = argc>3 ? atoi(argv[3])
+                             : std::thread::hardware_concurrency();
+  if (nthreads < 1) nthreads = 1;
+  if (nthreads > todo.size()) nthreads = todo.size();
+  TEST(nthreads)
+
+  ROOT::EnableThreadSafety();
+
+  std::atomic<size_t> next_job { 0 };
+  std::atomic<bool> failed { false };
+  std::mutex mx;
+  std::exception_ptr err;
+  auto worker = [&]{
+    try {
+      auto claim = [&]() -> job* {
+        const size_t i = next_job++;
+        return i < todo.size() && !failed ? todo[i] : nullptr;
+      };
+      auto prefetch = [&](const job* j) {
+        return std::async(std::launch::async,
+          open_input, *j->fname, j->is_mc, cache_size, std::cref(weights));
+      };
+      job* next = claim();
+      std::future<input> next_in;
+      if (next) next_in = prefetch(next);
+
+      while (next) {
+        auto& j = *next;
+        input in = next_in.get();
+        // open the next file while this one is converted
+        if ((next = claim())) next_in = prefetch(next);
+
+        const auto [size, mtime] = input_stat(*j.fname);
+        const string shard = out_dir + '/' + j.shard;
+        std::ofstream out(shard, std::ios::binary);
+        j.nevents = convert(in, j.is_mc, j.s->lumi/total_lumi, weights, out);
+        j.norm = in.n_all;
+        out.close();
+        if (!out) throw error("failed to write shard \"",shard,'\"');
+        j.done = true;
+
+        const auto* cache = dynamic_cast<TTreeCache*>(
+          in.file->GetCacheRead(in.tree));
+
+        std::lock_guard<std::mutex> lock(mx);
+        cout << *j.fname << " \033[36m" << j.nevents << "\033[0m";
+        // misses are reads of branches that were not in the cache,
+        // which the prefetch did not cover
+        if (cache) cout
+             << " cache eff: " << cache->GetEfficiency()
+             << ", miss eff: " << cache->GetMissEfficiency()
+             << ", uncached: " << cache->GetNoCacheBytesRead()*1e-6 << " MB"
+             << " in " << cache->GetNoCacheReadCalls() << " calls";
+        else cout << " no cache";
+        cout << ", read: " << in.file->GetBytesRead()*1e-6 << " MB"
+             << " in " << in.file->GetReadCalls() << " calls" << endl;
+        entries[*j.fname] = {
+          {"size", size},
+          {"mtime", mtime},
+          {"nevents", j.nevents},
+          {"lumi", j.s->lumi},
+          {"total_lumi", total_lumi},
+          {"weights", weight_specs},
+          {"norm", j.norm},
+          {"shard", j.shard},
+          {"shard_size", fs::file_size(shard)}
+        };
+        write_manifest();
+      }
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(mx);
+      if (!err) err = std::current_exception();
+      failed = true;
+    }
+  };
+  { vector<std::thread> threads;
+    threads.reserve(nthreads);
+    for (unsigned i=0; i<nthreads; ++i) threads.emplace_back(worker);
+    for (auto& t : threads) t.join();
+  }
+  if (err) std::rethrow_exception(err);
 
-        for (auto i : ph_i) {
-          write(float_t((*_photons[0])[i]*1e-3));
-          write((*_photons[1])[i]);
-          write((*_photons[2])[i]);
-          write(float_t((*_photons[3])[i]*1e-3));
-        }
+  // merge shards in order -----------------------------------------
+  for (const bool is_mc : {false,true}) {
+    if (to_stdout.size() && is_mc!=(to_stdout=="mc")) continue;
+    std::ofstream file;
+    if (to_stdout.empty())
+      file.open(cat(out_dir,"/hgam_",(is_mc?"mc":"data"),".dat"));
+    std::ostream& out = to_stdout.size() ? stdout_stream : file;
+    writer write(
+      out, is_mc, is_mc ? 0 : float_t(total_lumi*1e-3), format);
+    const unsigned nweights = format.nweights(is_mc);
+
+    for (const auto& j : jobs) {
+      if (j.is_mc != is_mc) continue;
+      const string shard_name = out_dir+'/'+j.shard;
+      if (!fs::file_size(shard_name)) continue;
+      const auto shard = ivanp::mem_file::mmap(shard_name.c_str());
+      const char *rec = shard.mem(), *end = rec + shard.size();
+      uint32_t n = 0;
+      for (size_t len; rec < end; rec += len, ++n)
+        write.event(rec, len = record_size(rec,nweights));
+      if (rec!=end || n!=j.nevents) throw error(
+        "shard \"",shard_name,"\" is corrupt");
+    }
+    write.close();
 
-        const uint8_t njets = jet_i.size();
-        write(njets);
-        if (njets > 4) jet_i.resize(4);
-        for (auto i : jet_i) {
-          write(float_t((*_jets[0])[i]*1e-3));
-          write((*_jets[1])[i]);
-          write((*_jets[2])[i]);
-          write(float_t((*_jets[3])[i]*1e-3));
-        }
-      }
-    }}
+    const auto nevents = write.nevents();
     TEST(nevents)
-
-    out.flush();
-    out.seekp(nevents_pos);
-    write(nevents);
-    out.flush();
   }
 }
@@ -1,9 +1,9 @@
 #include <iostream>
 
 #include "ivanp/io/mem_file.hh"
-#include "ivanp/math/vec4.hh"
 #include "ivanp/timed_counter.hh"
 #include "reader2.hh"
+#include "lazy_vec4.hh"
 
 #define TEST(var) \
   std::cout << "\033[36m" #var "\033[0m = " << var << std::endl;
@@ -12,46 +12,45 @@ using std::cout;
 using std::endl;
 using std::cerr;
 
-using vec4 = ivanp::vec4<double>;
-
-float lumi=0, weight=1;
+float lumi=0;
 uint32_t nevents_total = 0;
 uint8_t njets = 0;
 
 int main(int argc, char* argv[]) {
   for (bool is_mc : {false,true}) {
-    reader read(is_mc ? "hgam_mc.dat" : "hgam_data.dat");
+    dataset read(argc>1+is_mc ? argv[1+is_mc]
+                              : is_mc ? "hgam_mc.dat" : "hgam_data.dat");
 
-    char dm;
-    read(dm);
-    if ((is_mc && dm!='m') || (!is_mc && dm!='d')) {
-      cerr << (is_mc ? "mc" : "data")
-           << " file begins with \'" << dm << "\'" << endl;
+    if (read.is_mc()!=is_mc) {
+      cerr << (is_mc ? "mc" : "data") << " file is not "
+           << (is_mc ? "mc" : "data") << endl;
       return 1;
     }
     if (!is_mc) {
-      read(lumi);
+      lumi = read.lumi();
       TEST(lumi);
-      weight = 1;
     }
-    read(nevents_total);
+    nevents_total = read.nevents();
     TEST(nevents_total);
 
-    vec4 ph[2], jets[4], diph;
+    // 4-vectors are only built for the diphoton mass
+    lazy_vec4 ph[2];
+    lazy_sum diph(ph[0],ph[1]);
+    lazy_jets jets;
     { ivanp::timed_counter<> ent;
-      for (; read; ++ent) {
+      for (hgam_event e; read.next(e); ++ent) {
         TEST(ent)
-        if (is_mc) read(weight);
-        read(ph[0]);
-        read(ph[1]);
-        diph = ph[0] + ph[1];
+        for (unsigned i=0; i<read.nweights(); ++i)
+          TEST(e.weight(i))
+        ph[0] = e.y[0];
+        ph[1] = e.y[1];
+        diph.reset();
         TEST(diph.m())
-        read(njets);
+        njets = e.njets;
         TEST((unsigned)njets)
-        if (njets>4) njets = 4;
-        // jets.resize(njets);
-        for (decltype(njets) i=0; i<njets; ++i) {
-          read(jets[i]);
+        jets.n = e.njets_stored;
+        for (unsigned i=0; i<jets.n; ++i) {
+          jets.v[i] = e.jet(i);
           TEST(jets[i].pt());
         }
 
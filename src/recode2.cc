@@ -0,0 +1,48 @@
+#include <iostream>
+#include <fstream>
+#include <cstring>
+
+#include "ivanp/timed_counter.hh"
+#include "reader2.hh"
+#include "writer2.hh"
+
+#define TEST(var) \
+  std::cout << "\033[36m" #var "\033[0m = " << var << std::endl;
+
+using std::cout;
+using std::endl;
+using std::cerr;
+
+int main(int argc, char* argv[]) {
+  if (argc<3) {
+    cout << "usage: " << argv[0]
+         << " in.dat out.dat [columnar] [compressed]\n"
+            "  compressed files are always columnar\n";
+    return 1;
+  }
+  reader read(argv[1]);
+  const bool is_mc = read.is_mc();
+  TEST(is_mc)
+  TEST(read.nevents())
+
+  hgam_format format = read.format();
+  format.columnar = format.compressed = false;
+  for (int i=3; i<argc; ++i) {
+    if (!strcmp(argv[i],"columnar")) format.columnar = true; else
+    if (!strcmp(argv[i],"compressed")) format.compressed = true;
+    else {
+      cerr << "\033[31munknown option \"" << argv[i] << "\"\033[0m\n";
+      return 1;
+    }
+  }
+
+  std::ofstream out(argv[2]);
+  writer write(out, is_mc, read.lumi(), format);
+
+  { ivanp::timed_counter<> ent;
+    for (hgam_event e; read.next(e); ++ent)
+      write.event(e.data(),e.size());
+  }
+  write.close();
+  TEST(write.nevents())
+}
@@ -1,16 +1,26 @@
 #include <cstring>
+#include <cerrno>
+#include <csignal>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #include <iostream>
+#include <sstream>
 #include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
 
 #include <nlohmann/json.hpp>
 
-#include "ivanp/math/vec4.hh"
 #include "ivanp/error.hh"
+#include "schema.hh"
+#include "batch.hh"
+#include "expr.hh"
 
 #define TEST(var) \
   std::cout << "\033[36m" #var "\033[0m = " << var << std::endl;
@@ -22,131 +32,296 @@ using nlohmann::json;
 using namespace ivanp;
 
 const unsigned nmax = 1000;
-const double jetR = 0.4;
 
 class file {
-  char *m, *pos, *end;
+  char *m;
+  const char *pos, *end;
 public:
-  file(const char* name) {
+  // populate: read the whole file into memory now
+  file(const char* name, bool populate = false) {
     struct stat sb;
     int fd = open(name, O_RDONLY);
     if (fd == -1) throw error("open");
     if (fstat(fd, &sb) == -1) throw error("fstat");
     if (!S_ISREG(sb.st_mode)) throw error("not a file");
     size_t len = sb.st_size;
-    m = reinterpret_cast<char*>(mmap(0,len,PROT_READ,MAP_SHARED,fd,0));
+    m = reinterpret_cast<char*>(mmap(0,len,PROT_READ,
+      MAP_SHARED | (populate ? MAP_POPULATE : 0),fd,0));
     if (m == MAP_FAILED) throw error("mmap");
     if (close(fd) == -1) throw error("close");
     pos = m;
     end = m + len;
   }
   ~file() { munmap(m,end-m); }
-  char get() { return *(pos++); }
-  template <typename T>
-  friend inline file& operator>>(file& f, T& x) {
-    memcpy(reinterpret_cast<char*>(&x),f.pos,sizeof(x));
-    f.pos += sizeof(x);
-    return f;
-  }
-  operator bool() const { return pos!=end; }
-  void skip(size_t off) { pos += off; }
-};
+  file(const file&) = delete;
+  file& operator=(const file&) = delete;
+  dat_schema schema() { return { pos, end }; }
 
-// ==================================================================
-ivanp::vec4<> y[2], yy;
-std::vector<ivanp::vec4<>> jets;
+  // reads the events after the header, one per query
+  class cursor {
+    const char *pos, *end;
+  public:
+    cursor(const char* pos, const char* end): pos(pos), end(end) { }
+    template <typename Decoder>
+    void operator()(const Decoder& decode, dat_event& e) {
+      pos = decode(pos,e);
+    }
+    operator bool() const { return pos!=end; }
+  };
+  cursor events() const { return { pos, end }; }
+};
 
-auto nj() noexcept { return jets.size(); }
+// a file with its header parsed, and optionally its events decoded
+struct dataset {
+  std::string name;
+  file dat;
+  dat_schema schema;
+  std::deque<batch_events> batches; // empty unless decoded
+  std::vector<uint32_t> run;
+  std::vector<uint64_t> event;
 
-#include "varfcns.hh"
-// ==================================================================
+  dataset(const char* name, bool populate = false)
+  : name(name), dat(name,populate), schema(dat.schema()) { }
 
-int main(int argc, char* argv[]) {
-  if (argc!=2) {
-    cerr << "usage: " << argv[0] << " file.dat\n";
-    return 1;
+  void decode() {
+    dispatch(schema,[&](auto decode){
+      if constexpr (!decltype(decode)::has_event_number)
+        throw error("no event numbers in \"",name,'\"');
+      else {
+        const auto b = std::make_unique<event_batch>();
+        dat_event ev;
+        for (auto e = dat.events(); e; ) {
+          e(decode,ev);
+          run.push_back(ev.runNumber);
+          event.push_back(ev.eventNumber);
+          b->add(reinterpret_cast<const char*>(ev.y[0]),
+                 reinterpret_cast<const char*>(ev.y[1]),
+                 ev.njets,ev.njets_stored,ev.jets);
+          if (b->full()) {
+            b->save(batches.emplace_back());
+            b->clear();
+          }
+        }
+        if (b->n) b->save(batches.emplace_back());
+      }
+    });
   }
+};
 
-  json req;
-  std::cin >> req;
-
-  file dat(argv[1]);
-  for (int nbraces=0;;) { // skip header
-    if (!dat) {
-      cerr << "file ended in header\n";
-      return 1;
+// prints [[run,event,vars...],...] of the events passing the cuts,
+// followed by the number of selected events beyond the first nmax
+void query(json& req, const dataset& d, std::ostream& out) {
+  // cuts and variables are expressions, see expr.hh
+  // cuts are ["var","l"|"g",x] or expression strings, e.g. "m_jj>400"
+  expr_program prog;
+  std::vector<unsigned> cuts, vars;
+  for (const auto& cut : req["cuts"]) {
+    if (cut.is_string()) {
+      cuts.push_back(prog.add(cut));
+      continue;
     }
-    const char c = dat.get();
-    if (c=='{') ++nbraces;
-    else if (c=='}') --nbraces;
-    if (!nbraces) break;
-  }
-
-  bool need_jets = false;
-  std::vector<std::function<bool()>> cuts;
-  const auto& req_cuts = req["cuts"];
-  cuts.reserve(req_cuts.size());
-  for (const auto& cut : req_cuts) {
-    const auto& fcn = fcns.at(cut.at(0).get_ref<const std::string&>().c_str());
+    const auto& name = cut.at(0).get_ref<const std::string&>();
     const auto& op = cut.at(1).get_ref<const std::string&>();
-    bool lt = false;
-    if (op=="l") lt = true; else
-    if (op!="g") throw error("unexpected cut operator \"",op,"\"");
-    const double x = cut.at(2).get<double>();
-    // cuts.emplace_back([=,f=fcn.f]{ return (f() < x) == cmp; });
-    cuts.emplace_back([=,f=fcn.f]{ return lt ? (f() < x) : (f() > x); });
-    if (fcn.need_jets) need_jets = true;
-  }
-
-  std::vector<double(*)()> vars;
-  const auto& req_vars = req.at("vars");
-  vars.reserve(req_vars.size());
-  for (const auto& var : req_vars) {
-    const auto& fcn = fcns.at(var.get_ref<const std::string&>().c_str());
-    vars.emplace_back(fcn.f);
-    if (fcn.need_jets) need_jets = true;
+    if (op!="l" && op!="g")
+      throw error("unexpected cut operator \"",op,"\"");
+    // the name can be an expression, json numbers are printed exactly
+    cuts.push_back(prog.add(
+      "("+name+")"+(op=="l" ? '<' : '>')+cut.at(2).dump()));
   }
+  for (const auto& var : req.at("vars"))
+    vars.push_back(prog.add(var.get_ref<const std::string&>()));
 
   unsigned nselected = 0;
-  uint32_t runNumber;
-  uint64_t eventNumber;
-  uint32_t njets;
-  float mom[4];
+  dat_event ev;
 
   bool first = true;
-  cout << '[';
-  for (;dat;) {
-    dat >> runNumber >> eventNumber;
-    dat >> mom;
-    y[0] = { mom, vec4<>::PtEtaPhiM };
-    dat >> mom;
-    y[1] = { mom, vec4<>::PtEtaPhiM };
-    yy = y[0] + y[1];
-    dat >> njets;
-    if (need_jets) {
-      jets.resize(njets);
-      for (decltype(njets) i=0; i<njets; ++i) {
-        dat >> mom;
-        jets[i] = { mom, vec4<>::PtEtaPhiM };
+  auto print = [&](uint32_t run, uint64_t event, auto&& var) {
+    if (first) first = false;
+    else out << ',';
+    out << '[' << run << ',' << event;
+    for (size_t i=0; i<vars.size(); ++i)
+      out << ',' << var(i);
+    out << ']';
+  };
+
+  out << '[';
+  dispatch(d.schema,[&](auto decode){
+    if constexpr (!decltype(decode)::has_event_number)
+      throw error("no event numbers in \"",d.name,'\"');
+    else {
+      const auto b = std::make_unique<event_batch>();
+      std::vector<uint32_t> run(batch_size);
+      std::vector<uint64_t> event(batch_size);
+      std::vector<char> pass(batch_size);
+      const uint32_t* runs = run.data();
+      const uint64_t* events = event.data();
+      auto flush = [&]{
+        b->decode();
+        prog(*b);
+        std::fill(pass.begin(),pass.begin()+b->n,1);
+        for (unsigned c : cuts) {
+          const double* x = prog[c];
+          for (unsigned i=0; i<b->n; ++i)
+            pass[i] &= x[i] > 0 || x[i] < 0; // nonzero, not NaN
+        }
+        for (unsigned i=0; i<b->n; ++i)
+          if (pass[i] && ++nselected <= nmax)
+            print(runs[i],events[i],
+              [&](size_t k){ return prog[vars[k]][i]; });
+        b->clear();
+      };
+      if (d.batches.size()) { // decoded in memory
+        size_t k = 0;
+        for (const auto& e : d.batches) {
+          b->load(e);
+          runs = d.run.data() + k;
+          events = d.event.data() + k;
+          k += e.n;
+          flush();
+        }
+        return;
+      }
+      for (auto dat = d.dat.events(); dat; ) {
+        dat(decode,ev);
+        run[b->n] = ev.runNumber;
+        event[b->n] = ev.eventNumber;
+        b->add(reinterpret_cast<const char*>(ev.y[0]),
+               reinterpret_cast<const char*>(ev.y[1]),
+               ev.njets,ev.njets_stored,ev.jets);
+        if (b->full()) flush();
+      }
+      if (b->n) flush();
+    }
+  });
+  if (nselected > nmax) out << ',' << (nselected-nmax);
+  out << "]";
+}
+
+using datasets = std::vector<std::unique_ptr<dataset>>;
+
+// requests and responses are single lines of JSON
+// a request can select a file with "file", as named on the command line,
+// the first file by default
+// errors are returned as {"error":"message"}
+void connection(int c, const datasets& ds) {
+  auto respond = [&](std::string line){
+    std::ostringstream out;
+    try {
+      json req = json::parse(line);
+      const dataset* d = ds.front().get();
+      if (req.contains("file")) {
+        const auto& name = req["file"].get_ref<const std::string&>();
+        d = nullptr;
+        for (const auto& x : ds)
+          if (x->name==name) d = x.get();
+        if (!d) throw error("unknown file \"",name,'\"');
+      }
+      query(req,*d,out);
+    } catch (const std::exception& e) {
+      out.str({});
+      out << json{{"error",e.what()}}.dump();
+    }
+    out << '\n';
+    const std::string s = out.str();
+    for (size_t a=0; a<s.size(); ) {
+      const ssize_t n = send(c,s.data()+a,s.size()-a,MSG_NOSIGNAL);
+      if (n < 0) {
+        if (errno==EINTR) continue;
+        return false;
       }
-    } else {
-      dat.skip(sizeof(mom)*njets);
+      a += n;
     }
+    return true;
+  };
 
-    for (const auto& cut : cuts)
-      if (!cut()) goto next_event;
+  std::string buf;
+  char tmp[1 << 12];
+  for (bool eof = false; !eof; ) {
+    const ssize_t n = read(c,tmp,sizeof(tmp));
+    if (n < 0 && errno==EINTR) continue;
+    if (n > 0) buf.append(tmp,n);
+    else { // the last request may not end in a newline
+      eof = true;
+      buf += '\n';
+    }
+    size_t a = 0;
+    for (size_t nl; (nl = buf.find('\n',a)) != std::string::npos; a = nl+1) {
+      if (buf.find_first_not_of(" \t\r",a) >= nl) continue; // blank
+      if (!respond(buf.substr(a,nl-a))) eof = true;
+    }
+    buf.erase(0,a);
+  }
+  close(c);
+}
 
-    if (++nselected <= nmax) {
-      if (first) first = false;
-      else cout << ',';
-      cout << '[' << runNumber << ',' << eventNumber;
-      for (const auto& var : vars)
-        cout << ',' << var();
-      cout << ']';
+void serve(const char* path, const datasets& ds) {
+  const int s = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (s == -1) throw error("socket");
+  sockaddr_un addr { };
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path))
+    throw error("socket path \"",path,"\" is too long");
+  strcpy(addr.sun_path,path);
+  // a socket left by a previous server is replaced, anything else is kept
+  struct stat sb;
+  if (lstat(path,&sb) == 0) {
+    if (!S_ISSOCK(sb.st_mode))
+      throw error("\"",path,"\" exists and is not a socket");
+    if (unlink(path) == -1) throw error("unlink");
+  } else if (errno != ENOENT) throw error("lstat");
+  if (bind(s,reinterpret_cast<sockaddr*>(&addr),sizeof(addr)) == -1)
+    throw error("bind");
+  if (listen(s,64) == -1) throw error("listen");
+  cout << "listening on " << path << endl;
+  for (;;) {
+    const int c = accept(s,nullptr,nullptr);
+    if (c == -1) {
+      if (errno==EINTR || errno==ECONNABORTED) continue;
+      throw error("accept");
     }
+    std::thread(connection,c,std::cref(ds)).detach();
+  }
+}
 
-next_event: ;
+int main(int argc, char* argv[]) {
+  if (argc > 2 && !strcmp(argv[1],"-l")) {
+    const char* path = argv[2];
+    bool decode = false;
+    argv += 2;
+    argc -= 2;
+    if (argc > 1 && !strcmp(argv[1],"-c")) {
+      decode = true;
+      ++argv;
+      --argc;
+    }
+    if (argc < 2) {
+      cerr << "no files to serve\n";
+      return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    datasets ds;
+    for (int i=1; i<argc; ++i) {
+      ds.push_back(std::make_unique<dataset>(argv[i],true));
+      if (decode) ds.back()->decode();
+      cout << argv[i] << ": " << (decode
+        ? std::to_string(ds.back()->event.size()) + " events"
+        : std::string("mapped")) << endl;
+    }
+    serve(path,ds);
+    return 0;
   }
-  if (nselected > nmax) cout << ',' << (nselected-nmax);
-  cout << "]";
+  if (argc!=2) {
+    cerr << "usage: " << argv[0] << " file.dat\n"
+            "       " << argv[0] << " -l socket [-c] file.dat ...\n"
+            "  -l serves requests on a Unix socket, one JSON per line,\n"
+            "  with \"file\" selecting one of the files, kept in memory\n"
+            "  -c also keeps the events decoded\n";
+    return 1;
+  }
+
+  json req;
+  std::cin >> req;
+
+  const dataset d(argv[1]);
+  query(req,d,cout);
 }
@@ -0,0 +1,110 @@
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <random>
+#include <cmath>
+
+#include "batch.hh"
+#include "lazy_vec4.hh"
+
+using std::cout;
+using std::endl;
+using std::cerr;
+
+// ==================================================================
+// event state for the per-event functions
+uint8_t njets=0;
+lazy_vec4 y[2];
+lazy_sum yy(y[0],y[1]);
+lazy_jets jets;
+
+auto nj() noexcept { return njets; }
+
+#include "varfcns.hh"
+// ==================================================================
+
+// evaluates every variable on random events with the batch functions,
+// and per event with the cached functions in varfcns.hh,
+// and checks that they agree
+int main(int argc, char* argv[]) {
+  const size_t n = argc>1 ? atoi(argv[1]) : 1 << 16;
+
+  std::mt19937_64 gen(12345);
+  std::exponential_distribution<float> pt(1./50);
+  std::uniform_real_distribution<float> eta_y(-2.4,2.4), eta_j(-4.4,4.4),
+    phi(-M_PI,M_PI), m_j(0,20);
+  std::poisson_distribution<unsigned> nj_dist(1.5);
+
+  // all jets are stored, at most 4, as the per-event functions only see
+  // the stored jets
+  struct record {
+    float p[6][4];
+    unsigned nj;
+  };
+  std::vector<record> events(n);
+  for (auto& e : events) {
+    for (unsigned k=0; k<2; ++k)
+      e.p[k][0] = 25+pt(gen), e.p[k][1] = eta_y(gen),
+      e.p[k][2] = phi(gen), e.p[k][3] = 0;
+    e.nj = std::min(nj_dist(gen),4u);
+    for (unsigned k=2; k<6; ++k)
+      e.p[k][0] = 30+pt(gen), e.p[k][1] = eta_j(gen),
+      e.p[k][2] = phi(gen), e.p[k][3] = m_j(gen);
+  }
+
+  std::vector<std::pair<const char*,double>> maxdev;
+  for (const auto& f : fcns) maxdev.emplace_back(f.first,0);
+
+  unsigned nfail = 0;
+  const auto b = std::make_unique<event_batch>();
+  std::vector<double> x(fcns.size()*batch_size);
+  auto flush = [&](size_t first) {
+    b->decode();
+    unsigned v = 0;
+    for (const auto& f : fcns)
+      batch_fcns.at(f.first)(*b,x.data()+(v++)*batch_size);
+    for (unsigned i=0; i<b->n; ++i) {
+      const auto& e = events[first+i];
+      y[0] = (const char*)e.p[0];
+      y[1] = (const char*)e.p[1];
+      yy.reset();
+      njets = e.nj;
+      jets.n = e.nj;
+      for (unsigned k=0; k<jets.n; ++k) jets.v[k] = (const char*)e.p[2+k];
+      reset_event_cache();
+      v = 0;
+      for (const auto& f : fcns) {
+        const double a = f.second.f(), c = x[v*batch_size+i];
+        double& dev = maxdev[v++].second;
+        if (std::isnan(a) || std::isnan(c)) {
+          if (std::isnan(a) != std::isnan(c)) {
+            cerr << "\033[31mfailed: " << f.first << " event " << first+i
+                 << ": " << a << " != " << c << "\033[0m\n";
+            ++nfail;
+          }
+          continue;
+        }
+        const double d = std::abs(a-c)/(1+std::abs(a));
+        if (d > dev) dev = d;
+      }
+    }
+    b->clear();
+  };
+  for (size_t i=0, first=0; i<n; ++i) {
+    const auto& e = events[i];
+    b->add((const char*)e.p[0],(const char*)e.p[1],e.nj,e.nj,
+           (const char*)e.p[2]);
+    if (b->full()) flush(first), first = i+1;
+    else if (i+1==n) flush(first);
+  }
+
+  for (const auto& [name,dev] : maxdev) {
+    const bool ok = dev < 1e-6;
+    cout << (ok ? "" : "\033[31m") << name << ' ' << dev
+         << (ok ? "" : "\033[0m") << '\n';
+    if (!ok) ++nfail;
+  }
+  cout << n << " events" << endl;
+
+  return nfail!=0;
+}
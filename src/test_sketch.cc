@@ -0,0 +1,71 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <limits>
+
+#include "sketch.hh"
+
+using std::cout;
+using std::endl;
+using std::cerr;
+
+// fills sketches with a variable undefined in some events,
+// like m_jj for Njets<2, which is NaN there,
+// and checks that the centroids only describe the defined values
+int main(int argc, char* argv[]) {
+  const size_t n = argc>1 ? atoi(argv[1]) : 1 << 20;
+  const double nan = std::numeric_limits<double>::quiet_NaN();
+
+  std::mt19937_64 gen(12345);
+  std::exponential_distribution<double> x(1./300);
+  std::poisson_distribution<unsigned> njets(1.5);
+  std::uniform_real_distribution<double> w(-0.2,1);
+
+  unsigned nfail = 0;
+  auto check = [&](bool ok, const char* what){
+    if (!ok) {
+      cerr << "\033[31mfailed: " << what << "\033[0m\n";
+      ++nfail;
+    }
+  };
+
+  // two sketches of halves of the events, merged, as in bin2
+  sketch s[2];
+  double sum = 0, min = std::numeric_limits<double>::infinity();
+  size_t ndef = 0;
+  for (size_t i=0; i<n; ++i) {
+    const double wi = w(gen);
+    double xi = x(gen);
+    if (njets(gen) < 2) xi = nan;
+    else {
+      sum += wi;
+      if (xi < min) min = xi;
+      ++ndef;
+    }
+    s[i%2].add(xi,wi);
+  }
+  s[0].add(std::numeric_limits<double>::infinity());
+  s[0] += s[1];
+
+  const auto& c = s[0].centroids();
+  double total = 0;
+  bool finite = true, sorted = true;
+  for (size_t i=0; i<c.size(); ++i) {
+    total += c[i].w;
+    finite = finite && std::isfinite(c[i].x)
+      && c[i].lo <= c[i].x && c[i].x <= c[i].hi
+      && std::isfinite(c[i].lo) && std::isfinite(c[i].hi);
+    if (i) sorted = sorted && c[i-1].x <= c[i].x;
+  }
+  cout << ndef << " of " << n << " values defined, "
+       << c.size() << " centroids" << endl;
+
+  check(finite,"centroids are finite");
+  check(sorted,"centroids are sorted");
+  check(std::abs(total-sum) <= 1e-9*ndef,"sum of weights");
+  check(s[0].min()==min,"minimum");
+  check(std::isfinite(s[0].max()),"maximum");
+
+  return nfail!=0;
+}